@@ -0,0 +1,107 @@
+#include "AccessorView.h"
+#include <algorithm>
+
+// Reads through memcpy because strided elements are not necessarily aligned
+template <typename T>
+static T ReadUnaligned(const unsigned char* bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+AccessorView::AccessorView(const tinygltf::Model& model, const tinygltf::Accessor& accessor, const std::vector<BufferSpan>* buffers) {
+    count = accessor.count;
+    componentType = accessor.componentType;
+    componentCount = std::max(tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type)), 1);
+    componentSize = std::max(tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType)), 1);
+    normalized = accessor.normalized;
+
+    if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size())) return;
+
+    const auto& bufferView = model.bufferViews[accessor.bufferView];
+    if (bufferView.buffer < 0 || bufferView.buffer >= static_cast<int>(model.buffers.size())) return;
+
+    const unsigned char* bufferData = model.buffers[bufferView.buffer].data.data();
+    size_t bufferSize = model.buffers[bufferView.buffer].data.size();
+    if (buffers && bufferView.buffer < static_cast<int>(buffers->size())) {
+        bufferData = (*buffers)[bufferView.buffer].data;
+        bufferSize = (*buffers)[bufferView.buffer].size;
+    }
+
+    int byteStride = accessor.ByteStride(bufferView);
+    if (byteStride <= 0) return;
+    stride = static_cast<size_t>(byteStride);
+
+    // Accessors that would read past the buffer are treated as empty rather than read out of bounds
+    size_t offset = bufferView.byteOffset + accessor.byteOffset;
+    size_t elementSize = static_cast<size_t>(componentCount) * componentSize;
+    if (count > 0 && offset + (count - 1) * stride + elementSize > bufferSize) {
+        count = 0;
+        return;
+    }
+
+    data = bufferData + offset;
+}
+
+float AccessorView::ReadComponent(const unsigned char* component) const {
+    switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+        return ReadUnaligned<float>(component);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+        float value = static_cast<float>(*component);
+        return normalized ? value / 255.0f : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_BYTE: {
+        float value = static_cast<float>(static_cast<signed char>(*component));
+        return normalized ? std::max(value / 127.0f, -1.0f) : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        float value = static_cast<float>(ReadUnaligned<GLushort>(component));
+        return normalized ? value / 65535.0f : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_SHORT: {
+        float value = static_cast<float>(ReadUnaligned<GLshort>(component));
+        return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        return static_cast<float>(ReadUnaligned<GLuint>(component));
+    default:
+        return 0.0f;
+    }
+}
+
+glm::vec2 AccessorView::GetVec2(size_t element) const {
+    if (!data) return glm::vec2(0.0f);
+
+    const unsigned char* bytes = data + element * stride;
+    if (componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && componentCount >= 2) {
+        return glm::vec2(ReadUnaligned<float>(bytes), ReadUnaligned<float>(bytes + 4));
+    }
+    return glm::vec2(GetComponent(element, 0), GetComponent(element, 1));
+}
+
+glm::vec3 AccessorView::GetVec3(size_t element) const {
+    if (!data) return glm::vec3(0.0f);
+
+    const unsigned char* bytes = data + element * stride;
+    if (componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && componentCount >= 3) {
+        return glm::vec3(ReadUnaligned<float>(bytes), ReadUnaligned<float>(bytes + 4), ReadUnaligned<float>(bytes + 8));
+    }
+    return glm::vec3(GetComponent(element, 0), GetComponent(element, 1), GetComponent(element, 2));
+}
+
+GLuint AccessorView::GetIndex(size_t element) const {
+    if (!data) return 0;
+
+    const unsigned char* bytes = data + element * stride;
+    switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        return ReadUnaligned<GLuint>(bytes);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+        return ReadUnaligned<GLushort>(bytes);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        return *bytes;
+    default:
+        return 0;
+    }
+}
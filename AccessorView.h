@@ -0,0 +1,49 @@
+#ifndef ACCESSOR_VIEW_H
+#define ACCESSOR_VIEW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tinygltf/tiny_gltf.h>
+#include <cstring>
+#include <vector>
+
+// Bytes of one glTF buffer, used instead of Buffer::data for buffers that are read in place from a memory-mapped file
+struct BufferSpan {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// Reads the elements of a glTF accessor straight from its buffer, without copying it first.
+// Follows the buffer view's byteStride and converts integer components to float, normalized ones to [0, 1] or [-1, 1].
+// Accessors without a buffer view read as zeros, as the spec requires for sparse accessors without base data.
+class AccessorView {
+public:
+    // buffers, when given, holds one span per model buffer and replaces the buffers' data
+    AccessorView(const tinygltf::Model& model, const tinygltf::Accessor& accessor, const std::vector<BufferSpan>* buffers = nullptr);
+
+    size_t GetCount() const { return count; }
+    int GetComponentCount() const { return componentCount; }
+
+    float GetComponent(size_t element, int component) const {
+        if (!data || component >= componentCount) return 0.0f;
+        return ReadComponent(data + element * stride + component * componentSize);
+    }
+
+    glm::vec2 GetVec2(size_t element) const;
+    glm::vec3 GetVec3(size_t element) const;
+    // Integer element for index accessors, unconverted
+    GLuint GetIndex(size_t element) const;
+
+private:
+    const unsigned char* data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    int componentCount = 1;
+    int componentSize = 4;
+    int componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+    bool normalized = false;
+
+    float ReadComponent(const unsigned char* component) const;
+};
+
+#endif
@@ -0,0 +1,399 @@
+#include "AssetLoader.h"
+#include "TextureCache.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stb/stb_image.h>
+#include <tinygltf/json.hpp>
+
+std::map<std::string, AssetLoader::Image> AssetLoader::images;
+std::map<std::string, AssetLoader::Gltf> AssetLoader::gltfs;
+std::vector<AssetLoader::Timing> AssetLoader::timings;
+double AssetLoader::prefetchMilliseconds = 0.0;
+unsigned int AssetLoader::prefetchThreads = 0;
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Keeps the uri of external images without decoding them, Texture decodes the file itself
+static bool SkipImageData(tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*)
+{
+	return true;
+}
+
+static bool IsBinaryGltf(const std::string& path)
+{
+	if (path.size() < 4)
+		return false;
+
+	std::string extension = path.substr(path.size() - 4);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return extension == ".glb";
+}
+
+// One-byte buffer tinygltf accepts in place of a buffer that is read from a mapping
+static const char* placeholderUri = "data:application/octet-stream;base64,AA==";
+
+// Finds the JSON and BIN chunks of a GLB file, bin stays null when the file has no BIN chunk
+static bool ReadGlbChunks(const unsigned char* file, size_t fileSize, const unsigned char*& json, size_t& jsonSize, const unsigned char*& bin, size_t& binSize)
+{
+	auto readUint = [&](size_t offset) { return static_cast<uint32_t>(file[offset] | file[offset + 1] << 8 | file[offset + 2] << 16 | static_cast<uint32_t>(file[offset + 3]) << 24); };
+
+	if (fileSize < 20 || std::memcmp(file, "glTF", 4) != 0 || readUint(4) != 2 || readUint(8) > fileSize || readUint(16) != 0x4E4F534A)
+		return false;
+
+	size_t length = readUint(8);
+	jsonSize = readUint(12);
+	if (20 + jsonSize > length)
+		return false;
+	json = file + 20;
+
+	size_t binHeader = 20 + ((jsonSize + 3) & ~static_cast<size_t>(3));
+	if (binHeader + 8 <= length && readUint(binHeader + 4) == 0x004E4942 && binHeader + 8 + readUint(binHeader) <= length)
+	{
+		bin = file + binHeader + 8;
+		binSize = readUint(binHeader);
+	}
+	return true;
+}
+
+// Points every buffer the mapping does not cover at the buffer's own data
+static void FillBufferSpans(const tinygltf::Model& model, GltfMapping& mapping)
+{
+	mapping.buffers.resize(model.buffers.size());
+	for (size_t i = 0; i < model.buffers.size(); i++)
+	{
+		if (mapping.buffers[i].data == nullptr)
+			mapping.buffers[i] = { model.buffers[i].data.data(), model.buffers[i].data.size() };
+	}
+}
+
+static bool ParseGltf(const std::string& path, tinygltf::Model& model, GltfMapping& mapping, std::string& err, std::string& warn)
+{
+	tinygltf::TinyGLTF loader;
+	loader.SetImageLoader(SkipImageData, nullptr);
+	bool binary = IsBinaryGltf(path);
+	std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+	MappedFile* file = new MappedFile();
+	if (!file->Open(path) || file->GetSize() > 0xffffffffu)
+	{
+		delete file;
+		bool loaded = binary ? loader.LoadBinaryFromFile(&model, &err, &warn, path) : loader.LoadASCIIFromFile(&model, &err, &warn, path);
+		FillBufferSpans(model, mapping);
+		return loaded;
+	}
+
+	const unsigned char* json = file->GetData();
+	size_t jsonSize = file->GetSize();
+	const unsigned char* bin = nullptr;
+	size_t binSize = 0;
+	bool readable = !binary || ReadGlbChunks(file->GetData(), file->GetSize(), json, jsonSize, bin, binSize);
+
+	// The buffers that can be mapped become placeholders in the JSON tinygltf parses, so it never copies them
+	nlohmann::json document = readable ? nlohmann::json::parse(json, json + jsonSize, nullptr, false) : nlohmann::json();
+	std::vector<std::string> uris;
+	std::vector<bool> mapped;
+	bool binMapped = false;
+
+	if (document.is_object() && document.count("buffers") && document["buffers"].is_array())
+	{
+		nlohmann::json& buffers = document["buffers"];
+		for (nlohmann::json& buffer : buffers)
+		{
+			BufferSpan span;
+			bool hasUri = buffer.is_object() && buffer.count("uri") && buffer["uri"].is_string();
+			size_t byteLength = buffer.is_object() && buffer.count("byteLength") && buffer["byteLength"].is_number_unsigned() ? buffer["byteLength"].get<size_t>() : 0;
+			uris.push_back(hasUri ? buffer["uri"].get<std::string>() : std::string());
+
+			if (byteLength > 0 && !hasUri && bin && byteLength <= binSize)
+			{
+				span = { bin, byteLength };
+				binMapped = true;
+			}
+			else if (byteLength > 0 && hasUri && uris.back().compare(0, 5, "data:") != 0)
+			{
+				MappedFile* external = new MappedFile();
+				if (external->Open(directory + uris.back()) && external->GetSize() >= byteLength)
+				{
+					span = { external->GetData(), byteLength };
+					mapping.files.push_back(external);
+				}
+				else
+				{
+					delete external;
+				}
+			}
+
+			mapped.push_back(span.data != nullptr);
+			mapping.buffers.push_back(span);
+			if (span.data)
+			{
+				buffer["uri"] = placeholderUri;
+				buffer["byteLength"] = 1;
+			}
+		}
+	}
+
+	// A GLB buffer without uri that could not be mapped needs the BIN chunk, tinygltf then loads the file unchanged
+	bool rewritten = std::find(mapped.begin(), mapped.end(), true) != mapped.end();
+	for (size_t i = 0; i < mapped.size() && binary; i++)
+	{
+		if (!mapped[i] && uris[i].empty())
+			rewritten = false;
+	}
+
+	if (!rewritten)
+	{
+		mapping.Close();
+		bool loaded = binary
+			? loader.LoadBinaryFromMemory(&model, &err, &warn, file->GetData(), static_cast<unsigned int>(file->GetSize()), directory)
+			: loader.LoadASCIIFromString(&model, &err, &warn, reinterpret_cast<const char*>(file->GetData()), static_cast<unsigned int>(file->GetSize()), directory);
+		delete file;
+		FillBufferSpans(model, mapping);
+		return loaded;
+	}
+
+	// Images stored in a mapped buffer view would be read from the placeholder, they get a placeholder uri instead
+	struct MappedImage
+	{
+		size_t index;
+		int bufferView;
+		std::string mimeType;
+	};
+	std::vector<MappedImage> mappedImages;
+
+	if (document.count("images") && document["images"].is_array() && document.count("bufferViews") && document["bufferViews"].is_array())
+	{
+		nlohmann::json& images = document["images"];
+		const nlohmann::json& bufferViews = document["bufferViews"];
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			nlohmann::json& image = images[i];
+			if (!image.is_object() || !image.count("bufferView") || !image["bufferView"].is_number_unsigned())
+				continue;
+
+			size_t view = image["bufferView"].get<size_t>();
+			if (view >= bufferViews.size() || !bufferViews[view].is_object() || !bufferViews[view].count("buffer") || !bufferViews[view]["buffer"].is_number_unsigned())
+				continue;
+
+			size_t buffer = bufferViews[view]["buffer"].get<size_t>();
+			if (buffer >= mapped.size() || !mapped[buffer])
+				continue;
+
+			std::string mimeType = image.count("mimeType") && image["mimeType"].is_string() ? image["mimeType"].get<std::string>() : std::string();
+			mappedImages.push_back({ i, static_cast<int>(view), mimeType });
+			image.erase("bufferView");
+			image["uri"] = placeholderUri;
+		}
+	}
+
+	std::string text = document.dump();
+	document = nlohmann::json();
+	bool loaded = loader.LoadASCIIFromString(&model, &err, &warn, text.c_str(), static_cast<unsigned int>(text.size()), directory);
+
+	if (binMapped)
+		mapping.files.push_back(file);
+	else
+		delete file;
+
+	if (!loaded || model.buffers.size() != mapped.size())
+	{
+		mapping.Close();
+		return false;
+	}
+
+	for (size_t i = 0; i < mapped.size(); i++)
+	{
+		if (!mapped[i])
+			continue;
+
+		model.buffers[i].uri = uris[i];
+		model.buffers[i].data.clear();
+		model.buffers[i].data.shrink_to_fit();
+	}
+
+	for (const MappedImage& mappedImage : mappedImages)
+	{
+		tinygltf::Image& image = model.images[mappedImage.index];
+		image.uri.clear();
+		image.bufferView = mappedImage.bufferView;
+		image.mimeType = mappedImage.mimeType;
+	}
+
+	FillBufferSpans(model, mapping);
+	return true;
+}
+
+void GltfMapping::Close()
+{
+	for (MappedFile* file : files)
+	{
+		delete file;
+	}
+	files.clear();
+	buffers.clear();
+}
+
+void AssetLoader::Prefetch(ThreadPool& pool, const std::vector<std::string>& imagePaths, const std::vector<std::string>& gltfPaths)
+{
+	auto start = std::chrono::steady_clock::now();
+	prefetchThreads = pool.GetThreadCount();
+
+	// Entries are created up front, so the workers only write into their own entry
+	std::vector<std::string> imageKeys;
+	std::vector<std::string> gltfKeys;
+
+	for (const std::string& path : imagePaths)
+	{
+		std::string key = TextureCache::CanonicalPath(path.c_str());
+		if (images.find(key) == images.end())
+		{
+			images[key] = Image();
+			imageKeys.push_back(key);
+		}
+	}
+
+	for (const std::string& path : gltfPaths)
+	{
+		std::string key = TextureCache::CanonicalPath(path.c_str());
+		if (gltfs.find(key) == gltfs.end())
+		{
+			gltfs[key];
+			gltfKeys.push_back(key);
+		}
+	}
+
+	size_t firstTiming = timings.size();
+
+	auto decodeImages = [&](const std::vector<std::string>& keys, size_t timingOffset)
+	{
+		pool.ParallelFor(0, static_cast<unsigned int>(keys.size()), [&](unsigned int first, unsigned int last)
+		{
+			for (unsigned int i = first; i < last; i++)
+			{
+				auto imageStart = std::chrono::steady_clock::now();
+				Image& image = images.at(keys[i]);
+				image.bytes = stbi_load(keys[i].c_str(), &image.width, &image.height, &image.channels, 0);
+				timings[timingOffset + i] = { keys[i], MillisecondsSince(imageStart) };
+			}
+		});
+	};
+
+	// The first round mixes images and glTF files, they are independent of each other
+	std::vector<std::string> roundKeys = imageKeys;
+	roundKeys.insert(roundKeys.end(), gltfKeys.begin(), gltfKeys.end());
+	timings.resize(firstTiming + roundKeys.size());
+
+	pool.ParallelFor(0, static_cast<unsigned int>(roundKeys.size()), [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = first; i < last; i++)
+		{
+			auto assetStart = std::chrono::steady_clock::now();
+
+			if (i < imageKeys.size())
+			{
+				Image& image = images.at(roundKeys[i]);
+				image.bytes = stbi_load(roundKeys[i].c_str(), &image.width, &image.height, &image.channels, 0);
+			}
+			else
+			{
+				Gltf& gltf = gltfs.at(roundKeys[i]);
+				gltf.loaded = ParseGltf(roundKeys[i], gltf.model, gltf.mapping, gltf.err, gltf.warn);
+			}
+
+			timings[firstTiming + i] = { roundKeys[i], MillisecondsSince(assetStart) };
+		}
+	});
+
+	// Images referenced by the glTF files, with the same paths Model builds for its textures
+	std::vector<std::string> referencedKeys;
+	for (const std::string& key : gltfKeys)
+	{
+		const Gltf& gltf = gltfs.at(key);
+		std::string directory = key.substr(0, key.find_last_of('/') + 1);
+
+		for (const auto& gltfImage : gltf.model.images)
+		{
+			if (gltfImage.uri.empty() || gltfImage.uri.compare(0, 5, "data:") == 0)
+				continue;
+
+			std::string imageKey = TextureCache::CanonicalPath((directory + gltfImage.uri).c_str());
+			if (images.find(imageKey) == images.end())
+			{
+				images[imageKey] = Image();
+				referencedKeys.push_back(imageKey);
+			}
+		}
+	}
+
+	size_t referencedTiming = timings.size();
+	timings.resize(referencedTiming + referencedKeys.size());
+	decodeImages(referencedKeys, referencedTiming);
+
+	prefetchMilliseconds = MillisecondsSince(start);
+}
+
+unsigned char* AssetLoader::LoadImageFile(const char* path, int* width, int* height, int* channels)
+{
+	auto image = images.find(TextureCache::CanonicalPath(path));
+	if (image == images.end() || image->second.bytes == nullptr)
+		return stbi_load(path, width, height, channels, 0);
+
+	unsigned char* bytes = image->second.bytes;
+	*width = image->second.width;
+	*height = image->second.height;
+	*channels = image->second.channels;
+	images.erase(image);
+	return bytes;
+}
+
+bool AssetLoader::LoadGltfFile(const std::string& path, tinygltf::Model& model, GltfMapping& mapping, std::string& err, std::string& warn)
+{
+	auto gltf = gltfs.find(TextureCache::CanonicalPath(path.c_str()));
+	if (gltf == gltfs.end())
+		return ParseGltf(path, model, mapping, err, warn);
+
+	// The spans stay valid, moving the model keeps the buffers' storage
+	model = std::move(gltf->second.model);
+	mapping = gltf->second.mapping;
+	err = gltf->second.err;
+	warn = gltf->second.warn;
+	bool loaded = gltf->second.loaded;
+	gltfs.erase(gltf);
+	return loaded;
+}
+
+void AssetLoader::PrintTimings()
+{
+	double workerMilliseconds = 0.0;
+	for (const Timing& timing : timings)
+	{
+		std::cout << "  " << timing.path << ": " << timing.milliseconds << " ms" << std::endl;
+		workerMilliseconds += timing.milliseconds;
+	}
+
+	std::cout << "Prefetched " << timings.size() << " assets in " << prefetchMilliseconds << " ms on " << prefetchThreads
+		<< " threads (" << workerMilliseconds << " ms of work)" << std::endl;
+}
+
+void AssetLoader::Clear()
+{
+	for (auto& image : images)
+	{
+		stbi_image_free(image.second.bytes);
+	}
+	images.clear();
+
+	for (auto& gltf : gltfs)
+	{
+		gltf.second.mapping.Close();
+	}
+	gltfs.clear();
+}
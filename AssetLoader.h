@@ -0,0 +1,74 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <tinygltf/tiny_gltf.h>
+
+#include "ThreadPool.h"
+#include "AccessorView.h"
+#include "MappedFile.h"
+
+// Memory mappings a glTF file was loaded from. buffers holds one span per model buffer:
+// buffers read in place are left empty in the tinygltf model and stay readable until Close.
+struct GltfMapping
+{
+	std::vector<BufferSpan> buffers;
+	std::vector<MappedFile*> files;
+
+	void Close();
+};
+
+// Reads images and glTF files on worker threads ahead of the GL objects that need them.
+// Texture, Skybox and Model take the prefetched data through LoadImageFile and LoadGltfFile,
+// so only the GL uploads run on the context thread. Paths that were not prefetched load synchronously.
+class AssetLoader
+{
+public:
+	// Decodes the images and parses the glTF files, then decodes the images the glTF files reference
+	static void Prefetch(ThreadPool& pool, const std::vector<std::string>& imagePaths, const std::vector<std::string>& gltfPaths);
+
+	// Same as stbi_load with 0 requested channels, free the result with stbi_image_free
+	static unsigned char* LoadImageFile(const char* path, int* width, int* height, int* channels);
+	// Parses .gltf and .glb files like TinyGLTF, external images are not decoded since Texture loads them from their uri.
+	// The GLB binary chunk and external .bin files are memory-mapped and read through mapping.buffers instead of being copied.
+	static bool LoadGltfFile(const std::string& path, tinygltf::Model& model, GltfMapping& mapping, std::string& err, std::string& warn);
+
+	// Worker time of every prefetched asset and the wall time of the last Prefetch
+	static void PrintTimings();
+	// Frees prefetched data nobody took, for example images already resident in the TextureCache
+	static void Clear();
+
+private:
+	struct Image
+	{
+		unsigned char* bytes = nullptr;
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+	};
+
+	struct Gltf
+	{
+		tinygltf::Model model;
+		GltfMapping mapping;
+		bool loaded = false;
+		std::string err;
+		std::string warn;
+	};
+
+	struct Timing
+	{
+		std::string path;
+		double milliseconds;
+	};
+
+	static std::map<std::string, Image> images;
+	static std::map<std::string, Gltf> gltfs;
+	static std::vector<Timing> timings;
+	static double prefetchMilliseconds;
+	static unsigned int prefetchThreads;
+};
+
+#endif
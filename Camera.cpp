@@ -110,3 +110,10 @@ void Camera::ResetPosition()
 	position.x = 0.0f;
 	position.z = 0.0f;
 }
+
+
+void Camera::ShiftPosition(float deltaX, float deltaZ)
+{
+	position.x -= deltaX;
+	position.z -= deltaZ;
+}
\ No newline at end of file
@@ -37,5 +37,6 @@ public:
 	glm::vec3 GetRight() const;
 
 	void ResetPosition();
+	void ShiftPosition(float deltaX, float deltaZ);
 };
 #endif
\ No newline at end of file
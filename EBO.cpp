@@ -1,10 +1,49 @@
 #include "EBO.h"
 
+GLsizeiptr EBO::allocatedBytes = 0;
+
+EBO::EBO()
+{
+}
+
 EBO::EBO(std::vector<GLuint>& indices)
 {
 	glGenBuffers(1, &id);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+	capacity = indices.size() * sizeof(GLuint);
+	allocatedBytes += capacity;
+}
+
+EBO::EBO(std::vector<GLushort>& indices)
+{
+	glGenBuffers(1, &id);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+	capacity = indices.size() * sizeof(GLushort);
+	allocatedBytes += capacity;
+}
+
+void EBO::Upload(const void* data, GLsizeiptr size)
+{
+	if (id == 0)
+		glGenBuffers(1, &id);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+
+	if (size > capacity)
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW);
+		allocatedBytes += size - capacity;
+		capacity = size;
+	}
+	else if (size > 0)
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, size, data);
+	}
 }
 
 void EBO::Bind()
@@ -20,4 +59,7 @@ void EBO::Unbind()
 void EBO::Delete()
 {
 	glDeleteBuffers(1, &id);
+	allocatedBytes -= capacity;
+	capacity = 0;
+	id = 0;
 }
\ No newline at end of file
@@ -7,8 +7,17 @@
 class EBO
 {
 public:
-	GLuint id;
+	GLuint id = 0;
+	GLsizeiptr capacity = 0;
+
+	static GLsizeiptr allocatedBytes;
+
+	EBO();
 	EBO(std::vector<GLuint>& indices);
+	EBO(std::vector<GLushort>& indices);
+
+	// Binds the buffer, so the target VAO has to be bound first
+	void Upload(const void* data, GLsizeiptr size);
 
 	void Bind();
 	void Unbind();
@@ -0,0 +1,276 @@
+#include "FractalNoise.h"
+
+#include <cmath>
+
+#if !defined(FRACTAL_NOISE_NO_SIMD) && defined(__AVX2__)
+#define FRACTAL_NOISE_AVX2
+#include <immintrin.h>
+#elif !defined(FRACTAL_NOISE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FRACTAL_NOISE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Same hashing constants and gradient table as FastNoiseLite, so every lane reproduces its scalar result
+static const int PrimeX = 501125321;
+static const int PrimeY = 1136930381;
+static const int HashMultiplier = 0x27d4eb2d;
+static const float PerlinScale = 1.4247691104677813f;
+
+#if defined(FRACTAL_NOISE_AVX2) || defined(FRACTAL_NOISE_SSE2)
+alignas(32) static const float Gradients2D[256] =
+{
+	0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+	0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+	0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+	-0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+	-0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+	-0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+	0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+	0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+	0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+	-0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+	-0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+	-0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+	0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+	0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+	0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+	-0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+	-0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+	-0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+	0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+	0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+	0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+	-0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+	-0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+	-0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+	0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+	0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+	0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+	-0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+	-0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+	-0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+	0.38268343236509f, 0.923879532511287f, 0.923879532511287f, 0.38268343236509f, 0.923879532511287f, -0.38268343236509f, 0.38268343236509f, -0.923879532511287f,
+	-0.38268343236509f, -0.923879532511287f, -0.923879532511287f, -0.38268343236509f, -0.923879532511287f, 0.38268343236509f, -0.38268343236509f, 0.923879532511287f,
+};
+#endif
+
+FractalNoise::FractalNoise(float frequency, int octaves, float lacunarity, float gain, int seed)
+	: seed(seed), frequency(frequency), octaves(octaves), lacunarity(lacunarity), gain(gain)
+{
+	noise.SetSeed(seed);
+	noise.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
+	noise.SetFractalType(FastNoiseLite::FractalType_FBm);
+	noise.SetFractalOctaves(octaves);
+	noise.SetFrequency(frequency);
+	noise.SetFractalLacunarity(lacunarity);
+	noise.SetFractalGain(gain);
+
+	// Matches FastNoiseLite::CalculateFractalBounding
+	float absGain = std::fabs(gain);
+	float amp = absGain;
+	float ampFractal = 1.0f;
+	for (int i = 1; i < octaves; i++)
+	{
+		ampFractal += amp;
+		amp *= absGain;
+	}
+	fractalBounding = 1 / ampFractal;
+}
+
+#if defined(FRACTAL_NOISE_AVX2)
+
+unsigned int FractalNoise::GetLaneCount() { return 8; }
+const char* FractalNoise::GetInstructionSet() { return "AVX2"; }
+
+static inline __m256 Lerp(__m256 a, __m256 b, __m256 t)
+{
+	return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+static inline __m256 InterpQuintic(__m256 t)
+{
+	__m256 cube = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+	__m256 inner = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f));
+	inner = _mm256_add_ps(_mm256_mul_ps(t, inner), _mm256_set1_ps(10.0f));
+	return _mm256_mul_ps(cube, inner);
+}
+
+static inline __m256 GradCoord(__m256i seed, __m256i xPrimed, __m256i yPrimed, __m256 xd, __m256 yd)
+{
+	__m256i hash = _mm256_xor_si256(_mm256_xor_si256(seed, xPrimed), yPrimed);
+	hash = _mm256_mullo_epi32(hash, _mm256_set1_epi32(HashMultiplier));
+	hash = _mm256_xor_si256(hash, _mm256_srai_epi32(hash, 15));
+	hash = _mm256_and_si256(hash, _mm256_set1_epi32(127 << 1));
+
+	__m256 xg = _mm256_i32gather_ps(Gradients2D, hash, 4);
+	__m256 yg = _mm256_i32gather_ps(Gradients2D, _mm256_or_si256(hash, _mm256_set1_epi32(1)), 4);
+
+	return _mm256_add_ps(_mm256_mul_ps(xd, xg), _mm256_mul_ps(yd, yg));
+}
+
+static inline __m256 SinglePerlin(int seed, __m256 x, __m256 y)
+{
+	// FastNoiseLite floors by truncating and subtracting one for every negative input
+	__m256i x0 = _mm256_add_epi32(_mm256_cvttps_epi32(x), _mm256_castps_si256(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ)));
+	__m256i y0 = _mm256_add_epi32(_mm256_cvttps_epi32(y), _mm256_castps_si256(_mm256_cmp_ps(y, _mm256_setzero_ps(), _CMP_LT_OQ)));
+
+	__m256 xd0 = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+	__m256 yd0 = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+	__m256 xd1 = _mm256_sub_ps(xd0, _mm256_set1_ps(1.0f));
+	__m256 yd1 = _mm256_sub_ps(yd0, _mm256_set1_ps(1.0f));
+
+	__m256 xs = InterpQuintic(xd0);
+	__m256 ys = InterpQuintic(yd0);
+
+	x0 = _mm256_mullo_epi32(x0, _mm256_set1_epi32(PrimeX));
+	y0 = _mm256_mullo_epi32(y0, _mm256_set1_epi32(PrimeY));
+	__m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(PrimeX));
+	__m256i y1 = _mm256_add_epi32(y0, _mm256_set1_epi32(PrimeY));
+
+	__m256i seedLanes = _mm256_set1_epi32(seed);
+	__m256 xf0 = Lerp(GradCoord(seedLanes, x0, y0, xd0, yd0), GradCoord(seedLanes, x1, y0, xd1, yd0), xs);
+	__m256 xf1 = Lerp(GradCoord(seedLanes, x0, y1, xd0, yd1), GradCoord(seedLanes, x1, y1, xd1, yd1), xs);
+
+	return _mm256_mul_ps(Lerp(xf0, xf1, ys), _mm256_set1_ps(PerlinScale));
+}
+
+void FractalNoise::GetNoiseRow(const float* x, float y, unsigned int count, float* out, float scale) const
+{
+	unsigned int i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 xLanes = _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_set1_ps(frequency));
+		__m256 yLanes = _mm256_set1_ps(y * frequency);
+		__m256 sum = _mm256_setzero_ps();
+		float amp = fractalBounding;
+
+		for (int octave = 0; octave < octaves; octave++)
+		{
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(SinglePerlin(seed + octave, xLanes, yLanes), _mm256_set1_ps(amp)));
+
+			xLanes = _mm256_mul_ps(xLanes, _mm256_set1_ps(lacunarity));
+			yLanes = _mm256_mul_ps(yLanes, _mm256_set1_ps(lacunarity));
+			amp *= gain;
+		}
+
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(sum, _mm256_set1_ps(scale)));
+	}
+
+	for (; i < count; i++)
+	{
+		out[i] = noise.GetNoise(x[i], y) * scale;
+	}
+}
+
+#elif defined(FRACTAL_NOISE_SSE2)
+
+unsigned int FractalNoise::GetLaneCount() { return 4; }
+const char* FractalNoise::GetInstructionSet() { return "SSE2"; }
+
+static inline __m128i MultiplyLow(__m128i a, __m128i b)
+{
+	// SSE2 has no 32 bit low multiply, so multiply the even and odd lanes separately and interleave them
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128 Lerp(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+static inline __m128 InterpQuintic(__m128 t)
+{
+	__m128 cube = _mm_mul_ps(_mm_mul_ps(t, t), t);
+	__m128 inner = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+	inner = _mm_add_ps(_mm_mul_ps(t, inner), _mm_set1_ps(10.0f));
+	return _mm_mul_ps(cube, inner);
+}
+
+static inline __m128 GradCoord(__m128i seed, __m128i xPrimed, __m128i yPrimed, __m128 xd, __m128 yd)
+{
+	__m128i hash = _mm_xor_si128(_mm_xor_si128(seed, xPrimed), yPrimed);
+	hash = MultiplyLow(hash, _mm_set1_epi32(HashMultiplier));
+	hash = _mm_xor_si128(hash, _mm_srai_epi32(hash, 15));
+	hash = _mm_and_si128(hash, _mm_set1_epi32(127 << 1));
+
+	alignas(16) int index[4];
+	_mm_store_si128(reinterpret_cast<__m128i*>(index), hash);
+
+	__m128 xg = _mm_setr_ps(Gradients2D[index[0]], Gradients2D[index[1]], Gradients2D[index[2]], Gradients2D[index[3]]);
+	__m128 yg = _mm_setr_ps(Gradients2D[index[0] | 1], Gradients2D[index[1] | 1], Gradients2D[index[2] | 1], Gradients2D[index[3] | 1]);
+
+	return _mm_add_ps(_mm_mul_ps(xd, xg), _mm_mul_ps(yd, yg));
+}
+
+static inline __m128 SinglePerlin(int seed, __m128 x, __m128 y)
+{
+	// FastNoiseLite floors by truncating and subtracting one for every negative input
+	__m128i x0 = _mm_add_epi32(_mm_cvttps_epi32(x), _mm_castps_si128(_mm_cmplt_ps(x, _mm_setzero_ps())));
+	__m128i y0 = _mm_add_epi32(_mm_cvttps_epi32(y), _mm_castps_si128(_mm_cmplt_ps(y, _mm_setzero_ps())));
+
+	__m128 xd0 = _mm_sub_ps(x, _mm_cvtepi32_ps(x0));
+	__m128 yd0 = _mm_sub_ps(y, _mm_cvtepi32_ps(y0));
+	__m128 xd1 = _mm_sub_ps(xd0, _mm_set1_ps(1.0f));
+	__m128 yd1 = _mm_sub_ps(yd0, _mm_set1_ps(1.0f));
+
+	__m128 xs = InterpQuintic(xd0);
+	__m128 ys = InterpQuintic(yd0);
+
+	x0 = MultiplyLow(x0, _mm_set1_epi32(PrimeX));
+	y0 = MultiplyLow(y0, _mm_set1_epi32(PrimeY));
+	__m128i x1 = _mm_add_epi32(x0, _mm_set1_epi32(PrimeX));
+	__m128i y1 = _mm_add_epi32(y0, _mm_set1_epi32(PrimeY));
+
+	__m128i seedLanes = _mm_set1_epi32(seed);
+	__m128 xf0 = Lerp(GradCoord(seedLanes, x0, y0, xd0, yd0), GradCoord(seedLanes, x1, y0, xd1, yd0), xs);
+	__m128 xf1 = Lerp(GradCoord(seedLanes, x0, y1, xd0, yd1), GradCoord(seedLanes, x1, y1, xd1, yd1), xs);
+
+	return _mm_mul_ps(Lerp(xf0, xf1, ys), _mm_set1_ps(PerlinScale));
+}
+
+void FractalNoise::GetNoiseRow(const float* x, float y, unsigned int count, float* out, float scale) const
+{
+	unsigned int i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 xLanes = _mm_mul_ps(_mm_loadu_ps(x + i), _mm_set1_ps(frequency));
+		__m128 yLanes = _mm_set1_ps(y * frequency);
+		__m128 sum = _mm_setzero_ps();
+		float amp = fractalBounding;
+
+		for (int octave = 0; octave < octaves; octave++)
+		{
+			sum = _mm_add_ps(sum, _mm_mul_ps(SinglePerlin(seed + octave, xLanes, yLanes), _mm_set1_ps(amp)));
+
+			xLanes = _mm_mul_ps(xLanes, _mm_set1_ps(lacunarity));
+			yLanes = _mm_mul_ps(yLanes, _mm_set1_ps(lacunarity));
+			amp *= gain;
+		}
+
+		_mm_storeu_ps(out + i, _mm_mul_ps(sum, _mm_set1_ps(scale)));
+	}
+
+	for (; i < count; i++)
+	{
+		out[i] = noise.GetNoise(x[i], y) * scale;
+	}
+}
+
+#else
+
+unsigned int FractalNoise::GetLaneCount() { return 1; }
+const char* FractalNoise::GetInstructionSet() { return "scalar"; }
+
+void FractalNoise::GetNoiseRow(const float* x, float y, unsigned int count, float* out, float scale) const
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		out[i] = noise.GetNoise(x[i], y) * scale;
+	}
+}
+
+#endif
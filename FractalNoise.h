@@ -0,0 +1,33 @@
+#ifndef FRACTAL_NOISE_H
+#define FRACTAL_NOISE_H
+
+#include <fastnoiselite/fast_noise_lite.h>
+
+// Perlin FBm with the same settings and output as FastNoiseLite, evaluated several samples at a time.
+// Uses AVX2 (8 lanes) when the build enables it, SSE2 (4 lanes) otherwise, and FastNoiseLite itself as the scalar fallback.
+// Define FRACTAL_NOISE_NO_SIMD to force the scalar path.
+class FractalNoise
+{
+public:
+	FractalNoise(float frequency, int octaves, float lacunarity, float gain, int seed = 1337);
+
+	float GetNoise(float x, float y) const { return noise.GetNoise(x, y); }
+
+	// out[i] = noise(x[i], y) * scale, for one row of samples that share y
+	void GetNoiseRow(const float* x, float y, unsigned int count, float* out, float scale = 1.0f) const;
+
+	static unsigned int GetLaneCount();
+	static const char* GetInstructionSet();
+
+private:
+	FastNoiseLite noise;
+
+	int seed;
+	float frequency;
+	int octaves;
+	float lacunarity;
+	float gain;
+	float fractalBounding;
+};
+
+#endif
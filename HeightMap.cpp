@@ -0,0 +1,68 @@
+#include "HeightMap.h"
+
+GLsizeiptr HeightMap::allocatedBytes = 0;
+
+HeightMap::HeightMap(GLuint slot)
+{
+	unit = slot;
+}
+
+void HeightMap::Upload(const float* data, GLsizei width, GLsizei height)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+
+	if (id == 0)
+	{
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	else
+	{
+		glBindTexture(GL_TEXTURE_2D, id);
+	}
+
+	if (width != HeightMap::width || height != HeightMap::height)
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, data);
+
+		allocatedBytes += static_cast<GLsizeiptr>(width) * height * sizeof(float) - static_cast<GLsizeiptr>(HeightMap::width) * HeightMap::height * sizeof(float);
+		HeightMap::width = width;
+		HeightMap::height = height;
+	}
+	else
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, data);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void HeightMap::Bind(Shader& shader, const char* uniform)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glUniform1i(glGetUniformLocation(shader.id, uniform), unit);
+}
+
+void HeightMap::Unbind()
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void HeightMap::Delete()
+{
+	glDeleteTextures(1, &id);
+	id = 0;
+
+	allocatedBytes -= static_cast<GLsizeiptr>(width) * height * sizeof(float);
+	width = 0;
+	height = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef HEIGHT_MAP_CLASS_H
+#define HEIGHT_MAP_CLASS_H
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+
+// Single channel float texture read with texelFetch, so it has no filtering or mipmaps
+class HeightMap
+{
+public:
+	GLuint id = 0;
+	GLuint unit;
+	GLsizei width = 0;
+	GLsizei height = 0;
+
+	static GLsizeiptr allocatedBytes;
+
+	HeightMap(GLuint slot);
+
+	// Replaces the contents in place, the storage is only reallocated when the size changes
+	void Upload(const float* data, GLsizei width, GLsizei height);
+
+	void Bind(Shader& shader, const char* uniform);
+	void Unbind();
+	void Delete();
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "Impostor.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+// Quad corners in units of the model's bounding radius, two triangles
+static const float impostorCorners[] =
+{
+	-1.0f, -1.0f,   1.0f, -1.0f,   1.0f,  1.0f,
+	-1.0f, -1.0f,   1.0f,  1.0f,  -1.0f,  1.0f
+};
+
+Impostor::Impostor(Model& model, Shader& captureShader, unsigned int viewCount, unsigned int tileSize, float startDistance, float fadeDistance)
+{
+	Impostor::viewCount = viewCount;
+	Impostor::radius = model.GetBoundingRadius();
+	Impostor::startDistance = startDistance;
+	Impostor::fadeDistance = fadeDistance;
+
+	vao.Bind();
+	quadVBO.Upload(impostorCorners, sizeof(impostorCorners));
+	vao.LinkAttribute(quadVBO, 0, 2, GL_FLOAT, 2 * sizeof(float), (void*)0);
+
+	instanceVBO.Upload(nullptr, 0);
+	vao.LinkAttribute(instanceVBO, 5, 3, GL_FLOAT, sizeof(InstanceData), (void*)offsetof(InstanceData, position));
+	vao.LinkAttribute(instanceVBO, 6, 2, GL_HALF_FLOAT, sizeof(InstanceData), (void*)offsetof(InstanceData, scale));
+	glVertexAttribDivisor(5, 1);
+	glVertexAttribDivisor(6, 1);
+	vao.Unbind();
+
+	Capture(model, captureShader, tileSize);
+}
+
+void Impostor::Capture(Model& model, Shader& captureShader, unsigned int tileSize)
+{
+	GLint previousViewport[4];
+	GLint previousFramebuffer;
+	glGetIntegerv(GL_VIEWPORT, previousViewport);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+	GLsizei atlasWidth = viewCount * tileSize;
+
+	glGenTextures(1, &atlas);
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasWidth, tileSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// A temporary FBO of its own: Framebuffer is tied to the window size with a multisampled target and a resolve blit,
+	// and Shadows only has a depth attachment, neither can render into an atlas texture owned by someone else
+	GLuint captureFBO, captureRBO;
+	glGenFramebuffers(1, &captureFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas, 0);
+
+	glGenRenderbuffers(1, &captureRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasWidth, tileSize);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
+
+	auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (fboStatus != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "Impostor framebuffer error: " << fboStatus << std::endl;
+
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+
+	// One upright instance at the origin, the caller uploads the real instances before the next draw
+	model.UpdateInstances(1, std::vector<InstanceData>(1, InstanceData(glm::vec3(0.0f), 1.0f, 0.0f)));
+
+	Camera captureCamera(tileSize, tileSize, glm::vec3(0.0f));
+	glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 4.0f * radius);
+
+	for (unsigned int view = 0; view < viewCount; view++)
+	{
+		// View i looks at the model from the direction (sin a, 0, cos a) in model space
+		float angle = 6.28318530718f * view / viewCount;
+		glm::vec3 direction(std::sin(angle), 0.0f, std::cos(angle));
+
+		captureCamera.position = 2.0f * radius * direction;
+		captureCamera.cameraMatrix = projection * glm::lookAt(captureCamera.position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		glViewport(view * tileSize, 0, tileSize, tileSize);
+		model.Draw(captureShader, captureCamera);
+	}
+
+	glDisable(GL_CULL_FACE);
+
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glDeleteRenderbuffers(1, &captureRBO);
+	glDeleteFramebuffers(1, &captureFBO);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void Impostor::UpdateInstances(const std::vector<InstanceData>& newInstances, glm::vec3 viewPosition, std::vector<InstanceData>& meshInstances)
+{
+	float fadeStart = std::max(startDistance - fadeDistance, 0.0f);
+	float fadeStartSquared = fadeStart * fadeStart;
+	float startSquared = startDistance * startDistance;
+
+	instances.clear();
+	meshInstances.clear();
+
+	for (const InstanceData& instance : newInstances)
+	{
+		glm::vec3 delta = instance.position - viewPosition;
+		float distanceSquared = glm::dot(delta, delta);
+
+		if (distanceSquared >= fadeStartSquared)
+			instances.push_back(instance);
+		if (distanceSquared < startSquared)
+			meshInstances.push_back(instance);
+	}
+
+	instanceCount = static_cast<unsigned int>(instances.size());
+	instanceVBO.Upload(instances.data(), instances.size() * sizeof(InstanceData));
+	instanceVBO.Unbind();
+}
+
+void Impostor::Draw(Shader& shader, Camera& camera)
+{
+	if (instanceCount == 0)
+		return;
+
+	shader.Activate();
+	vao.Bind();
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	glUniform1i(glGetUniformLocation(shader.id, "impostorAtlas"), 0);
+	glUniform1f(glGetUniformLocation(shader.id, "impostorRadius"), radius);
+	glUniform1f(glGetUniformLocation(shader.id, "impostorViewCount"), static_cast<float>(viewCount));
+	glUniform1f(glGetUniformLocation(shader.id, "impostorStart"), startDistance);
+	glUniform1f(glGetUniformLocation(shader.id, "impostorFade"), fadeDistance);
+
+	glUniform3f(glGetUniformLocation(shader.id, "cameraPosition"), camera.position.x, camera.position.y, camera.position.z);
+	camera.Matrix(shader, "cameraMatrix");
+
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instanceCount);
+
+	vao.Unbind();
+}
+
+void Impostor::SetMeshFade(Shader& meshShader)
+{
+	meshShader.Activate();
+	glUniform1f(glGetUniformLocation(meshShader.id, "impostorStart"), startDistance);
+	glUniform1f(glGetUniformLocation(meshShader.id, "impostorFade"), fadeDistance);
+}
+
+void Impostor::Delete()
+{
+	vao.Delete();
+	quadVBO.Delete();
+	instanceVBO.Delete();
+	glDeleteTextures(1, &atlas);
+}
@@ -0,0 +1,45 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Model.h"
+#include "VAO.h"
+
+// Views of a model rendered around the Y axis into one atlas row at load time. Distant instances are drawn as quads that face
+// the camera and blend the two captured views closest to their viewing angle.
+class Impostor
+{
+public:
+	// Instances from startDistance on only use the impostor, it fades in over the fadeDistance before that
+	Impostor(Model& model, Shader& captureShader, unsigned int viewCount, unsigned int tileSize, float startDistance, float fadeDistance);
+
+	// Keeps the instances from startDistance - fadeDistance on for Draw and writes the ones closer than startDistance to meshInstances.
+	// viewPosition is in the same space as the instance positions.
+	void UpdateInstances(const std::vector<InstanceData>& instances, glm::vec3 viewPosition, std::vector<InstanceData>& meshInstances);
+	unsigned int GetInstanceCount() const { return instanceCount; }
+
+	// shader is impostor.vert / impostor.frag, the caller sets the lighting, fog and instanceOrigin uniforms like for instance.vert
+	void Draw(Shader& shader, Camera& camera);
+	// Makes instance.vert / default.frag dither the mesh out with the pattern the impostor leaves free, so the two add up across the fade
+	void SetMeshFade(Shader& meshShader);
+	void Delete();
+
+private:
+	GLuint atlas = 0;
+	unsigned int viewCount;
+	float radius;
+	float startDistance;
+	float fadeDistance;
+
+	VAO vao;
+	VBO quadVBO;
+	VBO instanceVBO;
+	unsigned int instanceCount = 0;
+	std::vector<InstanceData> instances;
+
+	void Capture(Model& model, Shader& captureShader, unsigned int tileSize);
+};
+
+#endif
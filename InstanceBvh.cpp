@@ -0,0 +1,144 @@
+#include "InstanceBvh.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cfloat>
+
+void InstanceBvh::SetLeaf(unsigned int leaf, const std::vector<InstanceData>& instances, unsigned int first, unsigned int count)
+{
+	if (leaf >= leaves.size())
+		leaves.resize(leaf + 1);
+
+	Node& node = leaves[leaf];
+	node.min = glm::vec3(FLT_MAX);
+	node.max = glm::vec3(-FLT_MAX);
+	node.maxScale = 0.0f;
+	node.instanceCount = 0;
+	node.first = first;
+	node.count = count;
+
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		const InstanceData& instance = instances[i];
+		if (instance.scale == 0)
+			continue;
+
+		node.min = glm::min(node.min, instance.position);
+		node.max = glm::max(node.max, instance.position);
+		node.maxScale = std::max(node.maxScale, glm::unpackHalf1x16(instance.scale));
+		node.instanceCount++;
+	}
+}
+
+void InstanceBvh::Clear()
+{
+	leaves.clear();
+	nodes.clear();
+}
+
+void InstanceBvh::Build()
+{
+	nodes.clear();
+
+	std::vector<unsigned int> leafIndices;
+	for (unsigned int i = 0; i < leaves.size(); i++)
+	{
+		if (leaves[i].instanceCount > 0)
+			leafIndices.push_back(i);
+	}
+
+	if (!leafIndices.empty())
+		BuildNode(leafIndices, 0, static_cast<unsigned int>(leafIndices.size()));
+}
+
+int InstanceBvh::BuildNode(std::vector<unsigned int>& leafIndices, unsigned int begin, unsigned int end)
+{
+	int index = static_cast<int>(nodes.size());
+
+	if (end - begin == 1)
+	{
+		nodes.push_back(leaves[leafIndices[begin]]);
+		return index;
+	}
+
+	Node node;
+	node.min = glm::vec3(FLT_MAX);
+	node.max = glm::vec3(-FLT_MAX);
+	node.maxScale = 0.0f;
+	node.instanceCount = 0;
+
+	for (unsigned int i = begin; i < end; i++)
+	{
+		const Node& leaf = leaves[leafIndices[i]];
+		node.min = glm::min(node.min, leaf.min);
+		node.max = glm::max(node.max, leaf.max);
+		node.maxScale = std::max(node.maxScale, leaf.maxScale);
+		node.instanceCount += leaf.instanceCount;
+	}
+
+	// Median split of the leaf centres along the longer horizontal axis
+	int axis = node.max.x - node.min.x >= node.max.z - node.min.z ? 0 : 2;
+	unsigned int middle = (begin + end) / 2;
+	std::nth_element(leafIndices.begin() + begin, leafIndices.begin() + middle, leafIndices.begin() + end, [&](unsigned int a, unsigned int b)
+	{
+		return leaves[a].min[axis] + leaves[a].max[axis] < leaves[b].min[axis] + leaves[b].max[axis];
+	});
+
+	nodes.push_back(node);
+	int left = BuildNode(leafIndices, begin, middle);
+	int right = BuildNode(leafIndices, middle, end);
+	nodes[index].left = left;
+	nodes[index].right = right;
+
+	return index;
+}
+
+static float BoxDistanceSquared(const InstanceBvh::Node& node, glm::vec3 position)
+{
+	glm::vec3 delta = glm::max(glm::max(node.min - position, position - node.max), glm::vec3(0.0f));
+	return glm::dot(delta, delta);
+}
+
+int InstanceBvh::FindNearest(const std::vector<InstanceData>& instances, glm::vec3 position, float maxDistance) const
+{
+	int nearest = -1;
+	float nearestDistance = maxDistance * maxDistance;
+
+	if (nodes.empty())
+		return nearest;
+
+	std::vector<int> stack(1, 0);
+
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (BoxDistanceSquared(node, position) > nearestDistance)
+			continue;
+
+		if (node.left >= 0)
+		{
+			// The nearer child is pushed last so it is searched first and tightens the bound for the other one
+			bool leftFirst = BoxDistanceSquared(nodes[node.left], position) <= BoxDistanceSquared(nodes[node.right], position);
+			stack.push_back(leftFirst ? node.right : node.left);
+			stack.push_back(leftFirst ? node.left : node.right);
+			continue;
+		}
+
+		for (unsigned int i = node.first; i < node.first + node.count; i++)
+		{
+			if (instances[i].scale == 0)
+				continue;
+
+			glm::vec3 delta = instances[i].position - position;
+			float distance = glm::dot(delta, delta);
+			if (distance <= nearestDistance)
+			{
+				nearestDistance = distance;
+				nearest = static_cast<int>(i);
+			}
+		}
+	}
+
+	return nearest;
+}
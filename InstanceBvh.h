@@ -0,0 +1,43 @@
+#ifndef INSTANCE_BVH_H
+#define INSTANCE_BVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "VBO.h"
+
+// Bounding volume hierarchy over ranges of an instance array. Every leaf is one range and keeps the box of its positions,
+// so a leaf is refit on its own when its range changes and only the few nodes above the leaves are rebuilt.
+class InstanceBvh
+{
+public:
+	struct Node
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		float maxScale = 0.0f;
+		unsigned int instanceCount = 0;  // Non-empty instances below the node
+		int left = -1;                   // Children, -1 for leaves
+		int right = -1;
+		unsigned int first = 0;          // Instance range of a leaf
+		unsigned int count = 0;
+	};
+
+	// Refits leaf from instances [first, first + count), an empty range removes the leaf
+	void SetLeaf(unsigned int leaf, const std::vector<InstanceData>& instances, unsigned int first, unsigned int count);
+	void Clear();
+	// Rebuilds the nodes above the leaves after SetLeaf calls, the root is node 0
+	void Build();
+
+	const std::vector<Node>& GetNodes() const { return nodes; }
+
+	// Index of the non-empty instance closest to position within maxDistance, -1 if there is none
+	int FindNearest(const std::vector<InstanceData>& instances, glm::vec3 position, float maxDistance) const;
+
+private:
+	std::vector<Node> leaves;
+	std::vector<Node> nodes;
+
+	int BuildNode(std::vector<unsigned int>& leafIndices, unsigned int begin, unsigned int end);
+};
+
+#endif
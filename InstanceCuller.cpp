@@ -0,0 +1,150 @@
+#include "InstanceCuller.h"
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// glm is column major, so row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+
+	for (glm::vec4& plane : planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+}
+
+bool Frustum::IntersectsSphere(glm::vec3 center, float radius) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+
+	return true;
+}
+
+Frustum::Containment Frustum::ClassifyBox(glm::vec3 min, glm::vec3 max) const
+{
+	Containment containment = Inside;
+
+	for (const glm::vec4& plane : planes)
+	{
+		// Corners furthest along and against the plane normal
+		glm::vec3 positive(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+		glm::vec3 negative(plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y, plane.z >= 0.0f ? min.z : max.z);
+
+		if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+			return Outside;
+
+		if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f)
+			containment = Intersects;
+	}
+
+	return containment;
+}
+
+void InstanceCuller::Cull(const std::vector<InstanceData>& instances, glm::vec3 origin, float extent, float boundingRadius, const glm::mat4& viewProjection, std::vector<InstanceData>& visible)
+{
+	Frustum frustum(viewProjection);
+
+	visible.clear();
+	drawnCount = 0;
+	culledCount = 0;
+
+	CullRange(instances.data(), static_cast<unsigned int>(instances.size()), frustum, origin, extent, boundingRadius, visible);
+}
+
+void InstanceCuller::Cull(const InstanceBvh& bvh, const std::vector<InstanceData>& instances, glm::vec3 origin, float extent, float boundingRadius, const glm::mat4& viewProjection, std::vector<InstanceData>& visible)
+{
+	Frustum frustum(viewProjection);
+	const std::vector<InstanceBvh::Node>& nodes = bvh.GetNodes();
+
+	visible.clear();
+	drawnCount = 0;
+	culledCount = 0;
+
+	if (nodes.empty())
+		return;
+
+	stack.assign(1, 0);
+
+	while (!stack.empty())
+	{
+		const InstanceBvh::Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		// Node boxes hold positions, the frustum test pads them by the largest bounding sphere below
+		glm::vec3 min = node.min - origin;
+		glm::vec3 max = node.max - origin;
+		glm::vec3 padding(boundingRadius * node.maxScale);
+
+		bool outsideExtent = extent > 0.0f && (min.x > extent || max.x < -extent || min.z > extent || max.z < -extent);
+		bool insideExtent = extent <= 0.0f || (min.x >= -extent && max.x <= extent && min.z >= -extent && max.z <= extent);
+		Frustum::Containment containment = outsideExtent ? Frustum::Outside : frustum.ClassifyBox(min - padding, max + padding);
+
+		if (containment == Frustum::Outside)
+		{
+			culledCount += node.instanceCount;
+			continue;
+		}
+
+		if (node.left >= 0)
+		{
+			stack.push_back(node.right);
+			stack.push_back(node.left);
+			continue;
+		}
+
+		if (containment == Frustum::Inside && insideExtent)
+		{
+			for (unsigned int i = node.first; i < node.first + node.count; i++)
+			{
+				if (instances[i].scale != 0)
+					visible.push_back(instances[i]);
+			}
+			drawnCount += node.instanceCount;
+			continue;
+		}
+
+		CullRange(instances.data() + node.first, node.count, frustum, origin, extent, boundingRadius, visible);
+	}
+}
+
+void InstanceCuller::CullRange(const InstanceData* instances, unsigned int count, const Frustum& frustum, glm::vec3 origin, float extent, float boundingRadius, std::vector<InstanceData>& visible)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const InstanceData& instance = instances[i];
+		if (instance.scale == 0)
+			continue;
+
+		glm::vec3 center = instance.position - origin;
+
+		if (extent > 0.0f && (std::abs(center.x) > extent || std::abs(center.z) > extent))
+		{
+			culledCount++;
+			continue;
+		}
+
+		if (!frustum.IntersectsSphere(center, boundingRadius * glm::unpackHalf1x16(instance.scale)))
+		{
+			culledCount++;
+			continue;
+		}
+
+		visible.push_back(instance);
+		drawnCount++;
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef INSTANCE_CULLER_H
+#define INSTANCE_CULLER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "VBO.h"
+#include "InstanceBvh.h"
+
+// Six planes pointing inwards, taken from a view projection matrix (Gribb and Hartmann)
+struct Frustum
+{
+	enum Containment { Outside, Intersects, Inside };
+
+	glm::vec4 planes[6];
+
+	Frustum(const glm::mat4& viewProjection);
+
+	bool IntersectsSphere(glm::vec3 center, float radius) const;
+	Containment ClassifyBox(glm::vec3 min, glm::vec3 max) const;
+};
+
+// Compacts instances to the ones whose bounding sphere touches a frustum, so instanced draws skip the rest
+class InstanceCuller
+{
+public:
+	// Counts of the last Cull, empty instances are not counted
+	unsigned int drawnCount = 0;
+	unsigned int culledCount = 0;
+
+	// Instance positions are world space and the frustum is relative to origin, like instanceOrigin in instance.vert.
+	// Instances further than extent from origin along x or z are culled as well (0 = no limit).
+	// boundingRadius is the model's radius around its own origin at scale 1.
+	void Cull(const std::vector<InstanceData>& instances, glm::vec3 origin, float extent, float boundingRadius, const glm::mat4& viewProjection, std::vector<InstanceData>& visible);
+
+	// Same result, but walks bvh so whole subtrees outside the frustum are skipped and leaves fully inside it are copied without tests
+	void Cull(const InstanceBvh& bvh, const std::vector<InstanceData>& instances, glm::vec3 origin, float extent, float boundingRadius, const glm::mat4& viewProjection, std::vector<InstanceData>& visible);
+
+private:
+	std::vector<int> stack;
+
+	void CullRange(const InstanceData* instances, unsigned int count, const Frustum& frustum, glm::vec3 origin, float extent, float boundingRadius, std::vector<InstanceData>& visible);
+};
+
+#endif
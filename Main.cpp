@@ -3,8 +3,13 @@
 #include "Skybox.h"
 #include "Framebuffer.h"
 #include "Shadows.h"
+#include "InstanceCuller.h"
+#include "Impostor.h"
+#include "TextureCache.h"
+#include "AssetLoader.h"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
 #include <random>
 #include <set>
 
@@ -35,12 +40,35 @@ int main()
 	gladLoadGL();
 	glViewport(0, 0, width, height);
 
+	// Image and glTF files are read on worker threads, the constructors below only upload them
+	auto startupStage = std::chrono::steady_clock::now();
+	auto startupStart = startupStage;
+	auto stageMilliseconds = [&startupStage]()
+	{
+		auto now = std::chrono::steady_clock::now();
+		double milliseconds = std::chrono::duration<double, std::milli>(now - startupStage).count();
+		startupStage = now;
+		return milliseconds;
+	};
+
+	{
+		ThreadPool loaderPool;
+		AssetLoader::Prefetch(loaderPool,
+			{ "Textures/Grass1.jpg", "Textures/Grass2.jpg", "Textures/Skybox.png" },
+			{ "Models/MyTree/scene.gltf", "Models/MyUfo/scene.gltf" });
+	}
+	AssetLoader::PrintTimings();
+	double prefetchMilliseconds = stageMilliseconds();
+
 	// Shaders
 	Shader defaultShader("default.vert", "default.frag");
 	Shader skyboxShader("skybox.vert", "skybox.frag");
 	Shader framebufferShader("framebuffer.vert", "framebuffer.frag");
 	Shader shadowMapShader("shadowMap.vert", "shadowMap.frag");
 	Shader instanceShader("instance.vert", "default.frag");
+	Shader terrainShader("terrain.vert", "default.frag");
+	Shader impostorCaptureShader("impostorCapture.vert", "impostorCapture.frag");
+	Shader impostorShader("impostor.vert", "impostor.frag");
 
 
 	glm::vec4 lightColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
@@ -61,6 +89,14 @@ int main()
 	glUniform4f(glGetUniformLocation(instanceShader.id, "lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
 	glUniform3f(glGetUniformLocation(instanceShader.id, "lightPosition"), lightPosition.x, lightPosition.y, lightPosition.z);
 
+	terrainShader.Activate();
+	glUniform4f(glGetUniformLocation(terrainShader.id, "lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
+	glUniform3f(glGetUniformLocation(terrainShader.id, "lightPosition"), lightPosition.x, lightPosition.y, lightPosition.z);
+
+	impostorShader.Activate();
+	glUniform4f(glGetUniformLocation(impostorShader.id, "lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
+	glUniform3f(glGetUniformLocation(impostorShader.id, "lightPosition"), lightPosition.x, lightPosition.y, lightPosition.z);
+
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_MULTISAMPLE);
 
@@ -83,6 +119,16 @@ int main()
 	glUniform1f(glGetUniformLocation(instanceShader.id, "fogStart"), fogStart);
 	glUniform1f(glGetUniformLocation(instanceShader.id, "fogEnd"), fogEnd);
 
+	terrainShader.Activate();
+	glUniform3f(glGetUniformLocation(terrainShader.id, "fogColor"), fogColor.x, fogColor.y, fogColor.z);
+	glUniform1f(glGetUniformLocation(terrainShader.id, "fogStart"), fogStart);
+	glUniform1f(glGetUniformLocation(terrainShader.id, "fogEnd"), fogEnd);
+
+	impostorShader.Activate();
+	glUniform3f(glGetUniformLocation(impostorShader.id, "fogColor"), fogColor.x, fogColor.y, fogColor.z);
+	glUniform1f(glGetUniformLocation(impostorShader.id, "fogStart"), fogStart);
+	glUniform1f(glGetUniformLocation(impostorShader.id, "fogEnd"), fogEnd);
+
 	// Create camera object
 	Camera camera(width, height, glm::vec3(0.0f, 0.0f, 0.0f));
 
@@ -94,6 +140,21 @@ int main()
 	int terrainOctaves = 4;						// Number of noise layers
 	float terrainLacunarity = 2.0f;             // Frequency multiplier per octave
 	float terrainGain = 0.5f;                   // Amplitude multiplier per octave
+	unsigned int terrainThreads = 0;            // Worker threads for terrain generation (0 = all cores)
+	bool terrainTimingReport = true;            // Print how long each terrain update takes
+	bool terrainAsyncUpdate = true;             // Build the next terrain window on a background thread
+	unsigned int terrainChunks = 8;             // Stream the terrain as chunks per side (0 = regenerate one mesh)
+	float terrainLodDistance = 15.0f;           // Chunks beyond this distance halve their resolution per doubling (0 = full detail)
+	unsigned int terrainNormalBenchmark = 0;    // Runs of the normal benchmark at startup, needs terrainChunks = 0 (0 = off)
+	unsigned int terrainPlacementBenchmark = 0; // Runs of the placement benchmark at startup (0 = off)
+	bool terrainGpuDisplacement = false;        // Displace a flat grid on the GPU from a height texture, needs terrainChunks = 0
+	bool treeCulling = true;                    // Upload only the trees inside the camera or light frustum each frame
+	bool treeLods = true;                       // Draw distant trees with simplified meshes, needs treeCulling
+	bool treeImpostors = true;                  // Draw trees beyond treeImpostorDistance as camera-facing quads, needs treeCulling
+	float treeImpostorDistance = 30.0f;         // Distance from which only the impostor is drawn
+	float treeImpostorFade = 5.0f;              // Impostors dither in over this distance before treeImpostorDistance
+	float treeCollisionRadius = 0.75f;          // The camera is kept this far from tree trunks (0 = walk through trees)
+	bool batchStaticModels = true;              // Draw the ufos from one shared vertex and index buffer
 
 	Terrain terrain(
 		terrainSize,
@@ -102,14 +163,27 @@ int main()
 		terrainNoiseFrequency,
 		terrainOctaves,
 		terrainLacunarity,
-		terrainGain
+		terrainGain,
+		terrainChunks,
+		terrainGpuDisplacement
 	);
+	double terrainMilliseconds = stageMilliseconds();
+
+	// The displaced grid has no heights or normals in its vertices, terrain.vert reads them from the height map
+	Shader& terrainDrawShader = terrainGpuDisplacement && terrainChunks == 0 ? terrainShader : defaultShader;
+
+	terrain.SetThreadCount(terrainThreads);
+	terrain.SetTimingReport(terrainTimingReport);
+	terrain.SetLodDistance(terrainLodDistance);
+	terrain.BenchmarkNormals(terrainNormalBenchmark);
 
 	// Terrain variables
 	glm::mat4 terrainModel = glm::mat4(1.0f);
 	float terrainOffsetX = 0.0;
 	float terrainOffsetZ = 0.0;
-	float generationThreshold = terrainSize * 0.25;
+	float generationThreshold = terrainChunks > 0 ? terrain.GetChunkSize() : terrainSize * 0.25;
+	// Shifts are whole grid steps so the terrain can reuse the heights it already sampled
+	float gridStep = terrain.GetGridStep();
 	
 	terrain.UpdateTerrain(terrainOffsetX, terrainOffsetZ);
 	terrainModel = glm::mat4(1.0f);
@@ -117,15 +191,51 @@ int main()
 	// Trees
 	float treeNoise = 5000.0f;
 	float treeScale = 0.5f; 
-	std::vector<glm::mat4> treeInstances = terrain.GenerateObjectPositions(3.0f, treeNoise, treeScale, terrainOffsetX, terrainOffsetZ, 1.25f);
-	Model tree("Models/MyTree/scene.gltf", treeInstances.size(), treeInstances);
+
+	ScatterSpecies treeSpecies;
+	treeSpecies.radius = 1.0f;
+	treeSpecies.densityMapScale = 1.0f;
+	treeSpecies.maxHeight = 8.0f;
+	treeSpecies.maxSlope = 35.0f;
+	treeSpecies.sizeScale = treeScale;
+	treeSpecies.scaleVariation = 0.2f;
+	treeSpecies.modelYOffset = 1.25f;
+
+	int treeLayer = terrain.AddScatterLayer(treeSpecies);
+	terrain.BenchmarkPlacement(treeNoise, terrainPlacementBenchmark);
+	stageMilliseconds();
+	Model tree("Models/MyTree/scene.gltf");
+
+	// Captured from the full detail meshes before the instances are uploaded, the capture draws one instance of the tree
+	Impostor treeImpostor(tree, impostorCaptureShader, 8, 128, treeImpostorDistance, treeImpostorFade);
+
+	// Detail behind the fog is not visible, so trees switch to coarser meshes towards fogStart
+	if (treeLods)
+	{
+		tree.AddSimplifiedLod(fogStart * 0.5f, tree.GetBoundingRadius() * 0.15f);
+		tree.AddSimplifiedLod(fogStart, tree.GetBoundingRadius() * 0.3f);
+	}
+	terrain.UploadObjectInstances(treeLayer, tree);
+
+	double treeMilliseconds = stageMilliseconds();
+
+	// Tree instances stay in world space, the shaders subtract the window centre and skip trees outside the window
+	glm::vec3 treeOrigin = terrain.GetObjectOrigin(treeLayer);
+	float treeExtent = terrain.GetSize() / 2.0f;
+
+	// With culling the shadow and main pass each upload the trees that survive against their own frustum
+	InstanceCuller treeCameraCuller;
+	InstanceCuller treeLightCuller;
+	std::vector<InstanceData> visibleTrees;
+	std::vector<InstanceData> nearTrees;
 
 	// Ufos
 	//float ufoNoise = 10.0f;
 	//float ufoScale = 0.5f;
-	//std::vector<glm::mat4> ufoInstances = terrain.GenerateObjectPositions(3.0f, ufoNoise, ufoScale, terrainOffsetX, terrainOffsetZ, 5.0f);
+	//std::vector<InstanceData> ufoInstances = terrain.GenerateObjectPositions(3.0f, ufoNoise, ufoScale, terrainOffsetX, terrainOffsetZ, 5.0f);
 	//Model ufo("Models/Ufo/scene.gltf", ufoInstances.size(), ufoInstances);
 	
+	stageMilliseconds();
 	Model ufo1("Models/MyUfo/scene.gltf");
 	glm::mat4 ufo1ModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(30.0f, 5.0f, 30.0f));
 
@@ -134,16 +244,46 @@ int main()
 
 	Model ufo3("Models/MyUfo/scene.gltf");
 	glm::mat4 ufo3ModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(20.0f, 7.5f, -10.0f));
+	double ufoMilliseconds = stageMilliseconds();
+
+	std::cout << "Model cache: " << Model::GetCachedAssetCount() << " assets, " << Model::GetAssetCacheHits() << " models reused a loaded asset" << std::endl;
+	std::cout << "Texture cache: " << TextureCache::GetResidentCount() << " textures, " << TextureCache::GetResidentBytes() / 1024 << " KB resident, "
+		<< TextureCache::GetHits() << " hits, " << TextureCache::GetMisses() << " misses" << std::endl;
+
+	// Batched models queue their meshes in Draw, staticBatch.Draw issues them after the last one
+	MeshBatch staticBatch;
+	if (batchStaticModels)
+	{
+		ufo1.Batch(staticBatch);
+		ufo2.Batch(staticBatch);
+		ufo3.Batch(staticBatch);
+
+		// The batch has to draw exactly the triangles the models would draw on their own
+		for (const Model* ufo : { &ufo1, &ufo2, &ufo3 })
+		{
+			if (ufo->GetBatchedTriangleCount() != ufo->GetTriangleCount(0))
+				std::cerr << "Static batch draws " << ufo->GetBatchedTriangleCount() << " triangles of a model with " << ufo->GetTriangleCount(0) << std::endl;
+		}
+	}
+	// Textures whose owners were all freed while loading and batching are dropped here
+	std::cout << "Texture cache: " << TextureCache::EvictUnused() << " unreferenced textures evicted, " << TextureCache::GetResidentCount() << " resident" << std::endl;
 
 
 	// Rocks
 	//float rockNoise = 300.0f;
 	//float rockScale = 0.01f;
-	//std::vector<glm::mat4> rockInstances = terrain.GenerateObjectPositions(3.0f, treeNoise, rockScale, terrainOffsetX, terrainOffsetZ);
+	//std::vector<InstanceData> rockInstances = terrain.GenerateObjectPositions(3.0f, treeNoise, rockScale, terrainOffsetX, terrainOffsetZ);
 	//Model rock("Models/MyRock/scene.gltf", rockInstances.size(), rockInstances);
 
 	// Skybox
+	stageMilliseconds();
 	Skybox skybox;
+	double skyboxMilliseconds = stageMilliseconds();
+
+	AssetLoader::Clear();
+	std::cout << "Startup: prefetch " << prefetchMilliseconds << " ms, terrain " << terrainMilliseconds << " ms, tree " << treeMilliseconds
+		<< " ms, ufos " << ufoMilliseconds << " ms, skybox " << skyboxMilliseconds << " ms, total "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count() << " ms" << std::endl;
 
 	// Framebuffer
 	Framebuffer framebuffer(samples, gamma, width, height);
@@ -165,6 +305,17 @@ int main()
 
 	instanceShader.Activate();
 	glUniformMatrix4fv(glGetUniformLocation(instanceShader.id, "lightProjection"), 1, GL_FALSE, glm::value_ptr(lightProjection));
+	glUniform3f(glGetUniformLocation(instanceShader.id, "instanceOrigin"), treeOrigin.x, treeOrigin.y, treeOrigin.z);
+	glUniform1f(glGetUniformLocation(instanceShader.id, "instanceExtent"), treeExtent);
+	if (treeCulling && treeImpostors)
+		treeImpostor.SetMeshFade(instanceShader);
+
+	terrainShader.Activate();
+	glUniformMatrix4fv(glGetUniformLocation(terrainShader.id, "lightProjection"), 1, GL_FALSE, glm::value_ptr(lightProjection));
+
+	impostorShader.Activate();
+	glUniformMatrix4fv(glGetUniformLocation(impostorShader.id, "lightProjection"), 1, GL_FALSE, glm::value_ptr(lightProjection));
+	glUniform3f(glGetUniformLocation(impostorShader.id, "instanceOrigin"), treeOrigin.x, treeOrigin.y, treeOrigin.z);
 
 	// Animation
 	float currentAnimationTime = 0.0f;
@@ -180,6 +331,9 @@ int main()
 	float distanceTravelledZ = 0.0f;
 	glm::vec3 previousPosition = camera.position;
 
+	float pendingShiftX = 0.0f;
+	float pendingShiftZ = 0.0f;
+
 	// Main while loop
 	while (!glfwWindowShouldClose(window))
 	{
@@ -205,7 +359,12 @@ int main()
 		if (timeDifference >= 1.0 / 5.0)
 		{
 			std::string FPS = std::to_string((1.0 / timeDifference) * counter);
-			std::string newTitle = "ComputerGraphicsFinalProject - " + FPS + "FPS";
+			std::string bufferMemory = std::to_string((Mesh::GetBufferMemory() + HeightMap::allocatedBytes) / (1024 * 1024));
+			std::string newTitle = "ComputerGraphicsFinalProject - " + FPS + "FPS - " + bufferMemory + "MB buffers";
+			if (treeCulling)
+				newTitle += " - trees " + std::to_string(treeCameraCuller.drawnCount) + " drawn, " + std::to_string(treeCameraCuller.culledCount) + " culled";
+			if (treeCulling && treeImpostors)
+				newTitle += ", " + std::to_string(treeImpostor.GetInstanceCount()) + " impostors";
 			glfwSetWindowTitle(window, newTitle.c_str());
 
 			previousTime = currentTime;
@@ -216,19 +375,51 @@ int main()
 		distanceTravelledZ = camera.position.z - previousPosition.z;
 		//std::cout << distanceTravelledX << ", " << distanceTravelledZ << std::endl;
 
+		bool terrainUpdated = false;
+
 		if (abs(distanceTravelledX) > generationThreshold || abs(distanceTravelledZ) > generationThreshold)
 		{
-			terrainOffsetX += distanceTravelledX;
-			terrainOffsetZ += distanceTravelledZ;
+			if (!terrainAsyncUpdate)
+			{
+				pendingShiftX = std::round(distanceTravelledX / gridStep) * gridStep;
+				pendingShiftZ = std::round(distanceTravelledZ / gridStep) * gridStep;
+
+				terrain.UpdateTerrain(terrainOffsetX + pendingShiftX, terrainOffsetZ + pendingShiftZ);
+				terrainUpdated = true;
+			}
+			else if (!terrain.IsUpdatePending())
+			{
+				pendingShiftX = std::round(distanceTravelledX / gridStep) * gridStep;
+				pendingShiftZ = std::round(distanceTravelledZ / gridStep) * gridStep;
+
+				terrain.BeginUpdate(terrainOffsetX + pendingShiftX, terrainOffsetZ + pendingShiftZ);
+			}
+		}
 
-			camera.ResetPosition();
+		if (terrainAsyncUpdate && terrain.FinishUpdate())
+		{
+			terrainUpdated = true;
+		}
+
+		if (terrainUpdated)
+		{
+			terrainOffsetX += pendingShiftX;
+			terrainOffsetZ += pendingShiftZ;
 
-			terrain.UpdateTerrain(terrainOffsetX, terrainOffsetZ);
+			// The camera keeps moving while an asynchronous update is built, so shift it instead of snapping it to the origin
+			camera.ShiftPosition(pendingShiftX, pendingShiftZ);
 			terrainModel = glm::mat4(1.0f);
 
-			// Generate positions for trees
-			treeInstances = terrain.GenerateObjectPositions(3, treeNoise, treeScale, terrainOffsetX, terrainOffsetZ, 1.25f);
-			tree.UpdateInstances(static_cast<unsigned int>(treeInstances.size()), treeInstances);
+			// Trees are generated together with the terrain, only the cells that entered or left the window are uploaded
+			if (!treeCulling)
+				terrain.UploadObjectInstances(treeLayer, tree);
+			treeOrigin = terrain.GetObjectOrigin(treeLayer);
+
+			instanceShader.Activate();
+			glUniform3f(glGetUniformLocation(instanceShader.id, "instanceOrigin"), treeOrigin.x, treeOrigin.y, treeOrigin.z);
+
+			impostorShader.Activate();
+			glUniform3f(glGetUniformLocation(impostorShader.id, "instanceOrigin"), treeOrigin.x, treeOrigin.y, treeOrigin.z);
 
 			//ufoInstances = terrain.GenerateObjectPositions(3, ufoNoise, ufoScale, terrainOffsetX, terrainOffsetZ, 5.0f);
 			//ufo.UpdateInstances(static_cast<unsigned int>(ufoInstances.size()), ufoInstances);
@@ -239,12 +430,13 @@ int main()
 
 			//std::cout << "Trees: " << treeInstances.size() << " Rocks: " << rockInstances.size() << std::endl;
 
-			ufo1ModelMatrix = glm::translate(ufo1ModelMatrix, glm::vec3(-distanceTravelledX, 0.0f, -distanceTravelledZ));
-			ufo2ModelMatrix = glm::translate(ufo2ModelMatrix, glm::vec3(-distanceTravelledX, 0.0f, -distanceTravelledZ));
-			ufo3ModelMatrix = glm::translate(ufo3ModelMatrix, glm::vec3(-distanceTravelledX, 0.0f, -distanceTravelledZ));
+			ufo1ModelMatrix = glm::translate(ufo1ModelMatrix, glm::vec3(-pendingShiftX, 0.0f, -pendingShiftZ));
+			ufo2ModelMatrix = glm::translate(ufo2ModelMatrix, glm::vec3(-pendingShiftX, 0.0f, -pendingShiftZ));
+			ufo3ModelMatrix = glm::translate(ufo3ModelMatrix, glm::vec3(-pendingShiftX, 0.0f, -pendingShiftZ));
 
 			distanceTravelledX = 0.0f;
-			previousPosition = camera.position;
+			distanceTravelledZ = 0.0f;
+			previousPosition = glm::vec3(0.0f, camera.position.y, 0.0f);
 		}
 
 		// Depth testing needed for Shadow Map
@@ -254,11 +446,23 @@ int main()
 
 		// Draw scene for shadow using instancing
 		shadowMapShader.Activate();
-		
+		glUniform3f(glGetUniformLocation(shadowMapShader.id, "instanceOrigin"), treeOrigin.x, treeOrigin.y, treeOrigin.z);
+		glUniform1f(glGetUniformLocation(shadowMapShader.id, "instanceExtent"), treeExtent);
+
+		if (treeCulling)
+		{
+			treeLightCuller.Cull(terrain.GetObjectBvh(treeLayer), terrain.GetObjectInstances(treeLayer), treeOrigin, treeExtent, tree.GetBoundingRadius(), lightProjection, visibleTrees);
+			tree.UpdateLodInstances(visibleTrees, camera.position + treeOrigin);
+		}
+
 		tree.Draw(shadowMapShader, camera);
+
+		glUniform3f(glGetUniformLocation(shadowMapShader.id, "instanceOrigin"), 0.0f, 0.0f, 0.0f);
+		glUniform1f(glGetUniformLocation(shadowMapShader.id, "instanceExtent"), 0.0f);
 		ufo1.Draw(shadowMapShader, camera, ufo1ModelMatrix);
 		ufo2.Draw(shadowMapShader, camera, ufo2ModelMatrix);
 		ufo3.Draw(shadowMapShader, camera, ufo3ModelMatrix);
+		staticBatch.Draw(shadowMapShader, camera);
 
 		//rock.Draw(shadowMapShader, camera);
 
@@ -269,6 +473,20 @@ int main()
 
 		// Handles camera
 		camera.Inputs(window);
+
+		// Only trees close to the camera's height block it, so flying over the forest is not affected
+		glm::vec3 nearestTree;
+		if (treeCollisionRadius > 0.0f && terrain.FindNearestObject(treeLayer, camera.position, treeCollisionRadius * 2.0f, nearestTree))
+		{
+			glm::vec2 away(camera.position.x - nearestTree.x, camera.position.z - nearestTree.z);
+			float distance = glm::length(away);
+			if (distance > 0.0001f && distance < treeCollisionRadius)
+			{
+				away *= treeCollisionRadius / distance;
+				camera.position.x = nearestTree.x + away.x;
+				camera.position.z = nearestTree.z + away.y;
+			}
+		}
 		camera.UpdateMatrix(45.0f, 0.1f, cameraEnd);
 
 		// Send the light matrix to the shader
@@ -283,21 +501,50 @@ int main()
 
 		shadows.Bind(instanceShader);
 
+		terrainShader.Activate();
+		glUniformMatrix4fv(glGetUniformLocation(terrainShader.id, "lightProjection"), 1, GL_FALSE, glm::value_ptr(lightProjection));
+
+		shadows.Bind(terrainShader);
+
+		impostorShader.Activate();
+		glUniformMatrix4fv(glGetUniformLocation(impostorShader.id, "lightProjection"), 1, GL_FALSE, glm::value_ptr(lightProjection));
+
+		shadows.Bind(impostorShader);
+
 		// Draw skybox
 		skybox.Draw(skyboxShader, camera, width, height);
 
 		// Draw scene		
 		glEnable(GL_CULL_FACE);
 
+		terrain.Draw(terrainDrawShader, camera, terrainModel);
+
 		defaultShader.Activate();
-		terrain.Draw(defaultShader, camera, terrainModel);
 		ufo1.Draw(defaultShader, camera, ufo1ModelMatrix);
 		ufo2.Draw(defaultShader, camera, ufo2ModelMatrix);
 		ufo3.Draw(defaultShader, camera, ufo3ModelMatrix);
+		staticBatch.Draw(defaultShader, camera);
 
 		// Draw instances
+		if (treeCulling)
+		{
+			treeCameraCuller.Cull(terrain.GetObjectBvh(treeLayer), terrain.GetObjectInstances(treeLayer), treeOrigin, treeExtent, tree.GetBoundingRadius(), camera.cameraMatrix, visibleTrees);
+
+			if (treeImpostors)
+			{
+				// Trees inside the fade band get both, the mesh and the impostor dither with complementary patterns
+				treeImpostor.UpdateInstances(visibleTrees, camera.position + treeOrigin, nearTrees);
+				tree.UpdateLodInstances(nearTrees, camera.position + treeOrigin);
+			}
+			else
+				tree.UpdateLodInstances(visibleTrees, camera.position + treeOrigin);
+		}
+
 		instanceShader.Activate();
 		tree.Draw(instanceShader, camera);
+
+		if (treeCulling && treeImpostors)
+			treeImpostor.Draw(impostorShader, camera);
 		//ufo.Draw(instanceShader, camera);
 		//rock.Draw(instanceShader, camera);
 
@@ -316,6 +563,18 @@ int main()
 	framebufferShader.Delete();
 	shadowMapShader.Delete();
 	instanceShader.Delete();
+	terrainShader.Delete();
+	impostorCaptureShader.Delete();
+	impostorShader.Delete();
+	treeImpostor.Delete();
+	tree.Delete();
+	ufo1.Delete();
+	ufo2.Delete();
+	ufo3.Delete();
+	staticBatch.Delete();
+	terrain.Delete();
+	// Every owner dropped its reference above, so this frees the remaining cached textures
+	TextureCache::EvictUnused();
 
 	framebuffer.Unbind();
 
@@ -5,37 +5,28 @@ Mesh::Mesh(
 	std::vector <GLuint>& indices,
 	std::vector <Texture>& textures,
 	unsigned int instancing,
-	std::vector <glm::mat4> instanceMatrix
+	std::vector <InstanceData> instances
 )
 {
 	Mesh::vertices = vertices;
 	Mesh::indices = indices;
 	Mesh::textures = textures;
+	for (Texture& texture : Mesh::textures)
+		texture.AddReference();
 	Mesh::instancing = instancing;
+	Mesh::indexCount = static_cast<GLsizei>(indices.size());
+	Mesh::indexType = GL_UNSIGNED_INT;
 
 	vao.Bind();
-	VBO vbo(vertices);
-	VBO instanceVBO(instanceMatrix);
-	EBO ebo(indices);
-	
-	vao.LinkAttribute(vbo, 0, 3, GL_FLOAT, sizeof(Vertex), (void*)0);
-	vao.LinkAttribute(vbo, 1, 3, GL_FLOAT, sizeof(Vertex), (void*)(3 * sizeof(float)));
-	vao.LinkAttribute(vbo, 2, 3, GL_FLOAT, sizeof(Vertex), (void*)(6 * sizeof(float)));
-	vao.LinkAttribute(vbo, 3, 2, GL_FLOAT, sizeof(Vertex), (void*)(9 * sizeof(float)));
-	vao.LinkAttribute(vbo, 4, 1, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, height));
+	vbo.Upload(vertices.data(), vertices.size() * sizeof(Vertex));
+	instanceVBO.Upload(instances.data(), instances.size() * sizeof(InstanceData));
+	ebo.Upload(indices.data(), indices.size() * sizeof(GLuint));
+
+	LinkVertexAttributes();
 
 	if (instancing != 1)
 	{
-		instanceVBO.Bind();
-		vao.LinkAttribute(instanceVBO, 5, 4, GL_FLOAT, sizeof(glm::mat4), (void*)0);
-		vao.LinkAttribute(instanceVBO, 6, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(1 * sizeof(glm::vec4)));
-		vao.LinkAttribute(instanceVBO, 7, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-		vao.LinkAttribute(instanceVBO, 8, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-		
-		glVertexAttribDivisor(5, 1);
-		glVertexAttribDivisor(6, 1);
-		glVertexAttribDivisor(7, 1);
-		glVertexAttribDivisor(8, 1);
+		LinkInstanceAttributes();
 	}
 
 	vao.Unbind();
@@ -44,6 +35,53 @@ Mesh::Mesh(
 	ebo.Unbind();
 }
 
+Mesh::Mesh(
+	std::vector <Vertex>& vertices,
+	EBO& sharedEBO,
+	GLsizei indexCount,
+	GLenum indexType,
+	std::vector <Texture>& textures
+)
+{
+	Mesh::vertices = vertices;
+	Mesh::textures = textures;
+	for (Texture& texture : Mesh::textures)
+		texture.AddReference();
+	Mesh::instancing = 1;
+	Mesh::indexCount = indexCount;
+	Mesh::indexType = indexType;
+
+	vao.Bind();
+	vbo.Upload(vertices.data(), vertices.size() * sizeof(Vertex));
+	sharedEBO.Bind();
+
+	LinkVertexAttributes();
+
+	vao.Unbind();
+	vbo.Unbind();
+	sharedEBO.Unbind();
+}
+
+void Mesh::LinkVertexAttributes()
+{
+	vao.LinkAttribute(vbo, 0, 3, GL_FLOAT, sizeof(Vertex), (void*)0);
+	vao.LinkAttribute(vbo, 1, 3, GL_FLOAT, sizeof(Vertex), (void*)(3 * sizeof(float)));
+	vao.LinkAttribute(vbo, 2, 3, GL_FLOAT, sizeof(Vertex), (void*)(6 * sizeof(float)));
+	vao.LinkAttribute(vbo, 3, 2, GL_FLOAT, sizeof(Vertex), (void*)(9 * sizeof(float)));
+	vao.LinkAttribute(vbo, 4, 1, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, height));
+}
+
+void Mesh::LinkInstanceAttributes()
+{
+	vao.LinkAttribute(instanceVBO, 5, 3, GL_FLOAT, sizeof(InstanceData), (void*)offsetof(InstanceData, position));
+	vao.LinkAttribute(instanceVBO, 6, 2, GL_HALF_FLOAT, sizeof(InstanceData), (void*)offsetof(InstanceData, scale));
+
+	glVertexAttribDivisor(5, 1);
+	glVertexAttribDivisor(6, 1);
+
+	instanceAttributesLinked = true;
+}
+
 void Mesh::Draw(Shader& shader, Camera& camera, glm::mat4 matrix, glm::vec3 translation, glm::quat rotation, glm::vec3 scale)
 {
 	shader.Activate();
@@ -85,11 +123,11 @@ void Mesh::Draw(Shader& shader, Camera& camera, glm::mat4 matrix, glm::vec3 tran
 		glUniformMatrix4fv(glGetUniformLocation(shader.id, "scale"), 1, GL_FALSE, glm::value_ptr(matrixScale));
 		glUniformMatrix4fv(glGetUniformLocation(shader.id, "model"), 1, GL_FALSE, glm::value_ptr(matrix));
 
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+		glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
 	}
 	else
 	{
-		glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instancing);
+		glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, instancing);
 	}
 
 	vao.Unbind();
@@ -101,43 +139,77 @@ void Mesh::UpdateVertices(std::vector<Vertex>& newVertices, std::vector <GLuint>
 {
 	Mesh::vertices = newVertices;
 	Mesh::indices = newIndices;
+	Mesh::indexCount = static_cast<GLsizei>(newIndices.size());
+	Mesh::indexType = GL_UNSIGNED_INT;
 
-	vao.Bind();
-	VBO vbo(newVertices);
-	EBO ebo(newIndices);
-
-	vao.LinkAttribute(vbo, 0, 3, GL_FLOAT, sizeof(Vertex), (void*)0);
-	vao.LinkAttribute(vbo, 1, 3, GL_FLOAT, sizeof(Vertex), (void*)(3 * sizeof(float)));
-	vao.LinkAttribute(vbo, 2, 3, GL_FLOAT, sizeof(Vertex), (void*)(6 * sizeof(float)));
-	vao.LinkAttribute(vbo, 3, 2, GL_FLOAT, sizeof(Vertex), (void*)(9 * sizeof(float)));
-	vao.LinkAttribute(vbo, 4, 1, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, height));
+	// The buffers keep their names, so the attribute pointers in the VAO stay valid
+	vbo.Upload(newVertices.data(), newVertices.size() * sizeof(Vertex));
 
+	vao.Bind();
+	ebo.Upload(newIndices.data(), newIndices.size() * sizeof(GLuint));
 	vao.Unbind();
+
 	vbo.Unbind();
 	ebo.Unbind();
 }
 
-void Mesh::UpdateInstanceMatrix(unsigned int newInstancing, std::vector <glm::mat4> newInstanceMatrix)
+void Mesh::UpdateVertices(std::vector<Vertex>& newVertices)
 {
-	Mesh::instancing = newInstancing;
+	Mesh::vertices = newVertices;
+
+	vbo.Upload(newVertices.data(), newVertices.size() * sizeof(Vertex));
+	vbo.Unbind();
+}
+
+void Mesh::SetIndexBuffer(EBO& sharedEBO, GLsizei newIndexCount, GLenum newIndexType)
+{
+	Mesh::indices.clear();
+	Mesh::indexCount = newIndexCount;
+	Mesh::indexType = newIndexType;
+
+	if (ebo.id != 0)
+		ebo.Delete();
 
 	vao.Bind();
-	VBO instanceVBO(newInstanceMatrix);
-	
-	if (instancing != 1)
+	sharedEBO.Bind();
+	vao.Unbind();
+	sharedEBO.Unbind();
+}
+
+void Mesh::UpdateInstances(unsigned int newInstancing, const std::vector <InstanceData>& newInstances)
+{
+	Mesh::instancing = newInstancing;
+
+	instanceVBO.Upload(newInstances.data(), newInstances.size() * sizeof(InstanceData));
+
+	if (instancing != 1 && !instanceAttributesLinked)
 	{
-		instanceVBO.Bind();
-		vao.LinkAttribute(instanceVBO, 5, 4, GL_FLOAT, sizeof(glm::mat4), (void*)0);
-		vao.LinkAttribute(instanceVBO, 6, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(1 * sizeof(glm::vec4)));
-		vao.LinkAttribute(instanceVBO, 7, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-		vao.LinkAttribute(instanceVBO, 8, 4, GL_FLOAT, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
-		glVertexAttribDivisor(5, 1);
-		glVertexAttribDivisor(6, 1);
-		glVertexAttribDivisor(7, 1);
-		glVertexAttribDivisor(8, 1);
+		vao.Bind();
+		LinkInstanceAttributes();
+		vao.Unbind();
 	}
 
-	vao.Unbind();
 	instanceVBO.Unbind();
+}
+
+void Mesh::UpdateInstanceRange(unsigned int first, unsigned int count, const InstanceData* instances)
+{
+	instanceVBO.UploadRange(instances, first * sizeof(InstanceData), count * sizeof(InstanceData));
+	instanceVBO.Unbind();
+}
+
+void Mesh::Delete()
+{
+	vao.Delete();
+	vbo.Delete();
+	instanceVBO.Delete();
+	ebo.Delete();
+
+	for (Texture& texture : textures)
+		texture.Delete();
+}
+
+GLsizeiptr Mesh::GetBufferMemory()
+{
+	return VBO::allocatedBytes + EBO::allocatedBytes;
 }
\ No newline at end of file
@@ -15,14 +15,28 @@ public:
 	std::vector <GLuint> indices;
 	std::vector <Texture> textures;
 	VAO vao;
+	VBO vbo;
+	VBO instanceVBO;
+	EBO ebo;
 
 	unsigned int instancing;
 
+	GLsizei indexCount;
+	GLenum indexType;
+
 	Mesh(std::vector <Vertex>& vertices,
 		std::vector <GLuint>& indices,
 		std::vector <Texture>& textures,
 		unsigned int instancing = 1,
-		std::vector <glm::mat4> instanceMatrix = {}
+		std::vector <InstanceData> instances = {}
+	);
+
+	// Uses an index buffer owned by the caller, which can be shared between meshes with the same topology
+	Mesh(std::vector <Vertex>& vertices,
+		EBO& sharedEBO,
+		GLsizei indexCount,
+		GLenum indexType,
+		std::vector <Texture>& textures
 	);
 
 	void Draw
@@ -36,7 +50,20 @@ public:
 	);
 
 	void UpdateVertices(std::vector<Vertex>& newVertices, std::vector <GLuint>& newIndices);
-	void UpdateInstanceMatrix(unsigned int instancing, std::vector <glm::mat4> instanceMatrix);
+	void UpdateVertices(std::vector<Vertex>& newVertices);
+	void SetIndexBuffer(EBO& sharedEBO, GLsizei newIndexCount, GLenum newIndexType);
+	void UpdateInstances(unsigned int instancing, const std::vector <InstanceData>& instances);
+	void UpdateInstanceRange(unsigned int first, unsigned int count, const InstanceData* instances);
+	void Delete();
+
+	// Bytes currently allocated in vertex and element buffers, across all meshes
+	static GLsizeiptr GetBufferMemory();
+
+private:
+	bool instanceAttributesLinked = false;
+
+	void LinkVertexAttributes();
+	void LinkInstanceAttributes();
 };
 
 #endif
\ No newline at end of file
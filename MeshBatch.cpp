@@ -0,0 +1,142 @@
+#include "MeshBatch.h"
+
+#include <iostream>
+#include <glm/gtc/type_ptr.hpp>
+
+unsigned int MeshBatch::Add(const std::vector <Vertex>& vertices, const std::vector <GLuint>& indices, const std::vector <Texture>& textures)
+{
+	MeshBatchRange range;
+	range.baseVertex = static_cast<GLint>(pendingVertices.size());
+	range.firstIndex = static_cast<GLsizei>(pendingIndices.size());
+	range.indexCount = static_cast<GLsizei>(indices.size());
+	range.textures = textures;
+	for (Texture& texture : range.textures)
+		texture.AddReference();
+
+	pendingVertices.insert(pendingVertices.end(), vertices.begin(), vertices.end());
+	pendingIndices.insert(pendingIndices.end(), indices.begin(), indices.end());
+	dirty = true;
+
+	ranges.push_back(range);
+	return static_cast<unsigned int>(ranges.size() - 1);
+}
+
+void MeshBatch::Upload()
+{
+	vao.Bind();
+	vbo.Upload(pendingVertices.data(), pendingVertices.size() * sizeof(Vertex));
+	// The buffer only exists after the first upload, so the attributes are linked to it here
+	LinkVertexAttributes();
+	ebo.Upload(pendingIndices.data(), pendingIndices.size() * sizeof(GLuint));
+	vao.Unbind();
+	vbo.Unbind();
+	ebo.Unbind();
+
+	// Later Adds re-upload the whole arena, so the vertices stay on the CPU
+	dirty = false;
+}
+
+void MeshBatch::LinkVertexAttributes()
+{
+	vao.LinkAttribute(vbo, 0, 3, GL_FLOAT, sizeof(Vertex), (void*)0);
+	vao.LinkAttribute(vbo, 1, 3, GL_FLOAT, sizeof(Vertex), (void*)(3 * sizeof(float)));
+	vao.LinkAttribute(vbo, 2, 3, GL_FLOAT, sizeof(Vertex), (void*)(6 * sizeof(float)));
+	vao.LinkAttribute(vbo, 3, 2, GL_FLOAT, sizeof(Vertex), (void*)(9 * sizeof(float)));
+	vao.LinkAttribute(vbo, 4, 1, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, height));
+
+	// Batched meshes would draw without vertices if an attribute was left on another buffer
+	for (GLuint attribute = 0; attribute < 5; attribute++)
+	{
+		GLint buffer = 0;
+		glGetVertexAttribiv(attribute, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+		if (static_cast<GLuint>(buffer) != vbo.id)
+			std::cerr << "MeshBatch vertex attribute " << attribute << " is not linked to the batch buffer" << std::endl;
+	}
+}
+
+void MeshBatch::Submit(unsigned int range, const glm::mat4& matrix)
+{
+	queue.push_back({ range, matrix });
+}
+
+void MeshBatch::Draw(Shader& shader, Camera& camera)
+{
+	drawCount = 0;
+	textureBindCount = 0;
+
+	if (queue.empty())
+		return;
+
+	if (dirty)
+		Upload();
+
+	shader.Activate();
+	vao.Bind();
+
+	glUniform3f(glGetUniformLocation(shader.id, "cameraPosition"), camera.position.x, camera.position.y, camera.position.z);
+	camera.Matrix(shader, "cameraMatrix");
+
+	// Batched meshes carry their whole transform in the model matrix
+	glm::mat4 identity = glm::mat4(1.0f);
+	glUniformMatrix4fv(glGetUniformLocation(shader.id, "translation"), 1, GL_FALSE, glm::value_ptr(identity));
+	glUniformMatrix4fv(glGetUniformLocation(shader.id, "rotation"), 1, GL_FALSE, glm::value_ptr(identity));
+	glUniformMatrix4fv(glGetUniformLocation(shader.id, "scale"), 1, GL_FALSE, glm::value_ptr(identity));
+	GLint modelLocation = glGetUniformLocation(shader.id, "model");
+
+	const std::vector <Texture>* boundTextures = nullptr;
+
+	for (const QueuedDraw& draw : queue)
+	{
+		MeshBatchRange& range = ranges[draw.range];
+
+		bool texturesChanged = boundTextures == nullptr || boundTextures->size() != range.textures.size();
+		for (size_t i = 0; !texturesChanged && i < range.textures.size(); i++)
+		{
+			texturesChanged = (*boundTextures)[i].id != range.textures[i].id;
+		}
+
+		if (texturesChanged)
+		{
+			unsigned int diffuseNum = 0;
+			for (unsigned int i = 0; i < range.textures.size(); i++)
+			{
+				std::string num;
+				std::string type = range.textures[i].type;
+
+				if (type == "diffuse")
+				{
+					num = std::to_string(diffuseNum++);
+				}
+
+				range.textures[i].TextureUnit(shader, (type + num).c_str(), i);
+				range.textures[i].Bind();
+			}
+
+			boundTextures = &range.textures;
+			textureBindCount++;
+		}
+
+		glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(draw.matrix));
+		glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+		drawCount++;
+	}
+
+	queue.clear();
+
+	vao.Unbind();
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void MeshBatch::Delete()
+{
+	vao.Delete();
+	vbo.Delete();
+	ebo.Delete();
+
+	for (MeshBatchRange& range : ranges)
+	{
+		for (Texture& texture : range.textures)
+			texture.Delete();
+	}
+	ranges.clear();
+}
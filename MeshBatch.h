@@ -0,0 +1,65 @@
+#ifndef MESH_BATCH_H
+#define MESH_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "VAO.h"
+#include "EBO.h"
+#include "Camera.h"
+#include "Texture.h"
+
+// Part of the shared buffers that holds one mesh, its indices are relative to baseVertex
+struct MeshBatchRange
+{
+	GLint baseVertex;
+	GLsizei firstIndex;
+	GLsizei indexCount;
+	std::vector <Texture> textures;
+};
+
+// Packs the vertices and indices of many static meshes into one VAO, VBO and EBO.
+// Meshes queue draws with Submit and Draw issues all of them with a single VAO bind,
+// rebinding textures only when they change between consecutive draws.
+class MeshBatch
+{
+public:
+	VAO vao;
+	VBO vbo;
+	EBO ebo;
+
+	// Draw calls issued by the last Draw and how many of those had to bind textures
+	unsigned int drawCount = 0;
+	unsigned int textureBindCount = 0;
+
+	// Appends a mesh and returns its range index, the buffers are uploaded on the next Draw
+	unsigned int Add(const std::vector <Vertex>& vertices, const std::vector <GLuint>& indices, const std::vector <Texture>& textures);
+	void Submit(unsigned int range, const glm::mat4& matrix);
+
+	// Uses the same uniforms as Mesh::Draw for non-instanced meshes and clears the queue
+	void Draw(Shader& shader, Camera& camera);
+	void Delete();
+
+	size_t GetRangeCount() const { return ranges.size(); }
+	size_t GetTriangleCount(unsigned int range) const { return ranges[range].indexCount / 3; }
+
+private:
+	struct QueuedDraw
+	{
+		unsigned int range;
+		glm::mat4 matrix;
+	};
+
+	std::vector <MeshBatchRange> ranges;
+	std::vector <QueuedDraw> queue;
+
+	// CPU copy of the arena, which is uploaded as a whole
+	std::vector <Vertex> pendingVertices;
+	std::vector <GLuint> pendingIndices;
+	bool dirty = false;
+
+	void Upload();
+	void LinkVertexAttributes();
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+// Texture coordinates are split into this many regions per unit, so faces that sample different parts of a texture stay apart
+static const float uvRegions = 8.0f;
+
+struct SimplifierCluster {
+    // Upper triangle of the summed plane quadric: aa ab ac ad bb bc bd cc cd dd
+    double quadric[10] = {};
+    glm::dvec3 positionSum = glm::dvec3(0.0);
+    unsigned int vertexCount = 0;
+    unsigned int firstVertex = 0;
+    glm::ivec3 cell;
+    int output = -1;
+};
+
+static void AddPlane(SimplifierCluster& cluster, glm::dvec4 plane, double weight)
+{
+    const double a = plane.x, b = plane.y, c = plane.z, d = plane.w;
+    const double terms[10] = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+
+    for (int i = 0; i < 10; ++i)
+        cluster.quadric[i] += weight * terms[i];
+}
+
+static glm::vec3 ClusterPosition(const SimplifierCluster& cluster, glm::vec3 boundsMin, float cellSize)
+{
+    glm::dvec3 mean = cluster.positionSum / static_cast<double>(cluster.vertexCount);
+    const double* q = cluster.quadric;
+
+    glm::dmat3 A(q[0], q[1], q[2],
+                 q[1], q[4], q[5],
+                 q[2], q[5], q[7]);
+    glm::dvec3 b(-q[3], -q[6], -q[8]);
+
+    // Flat or linear clusters leave the quadric singular, they keep the mean position
+    double scale = (q[0] + q[4] + q[7]) / 3.0;
+    double determinant = glm::determinant(A);
+    if (scale <= 0.0 || std::abs(determinant) < 1e-6 * scale * scale * scale)
+        return glm::vec3(mean);
+
+    glm::dvec3 optimum = glm::inverse(A) * b;
+
+    // The optimum can shoot far away for nearly singular quadrics, keep it within half a cell of the cluster's cell
+    glm::dvec3 cellMin = glm::dvec3(boundsMin) + glm::dvec3(cluster.cell) * static_cast<double>(cellSize) - 0.5 * cellSize;
+    glm::dvec3 cellMax = cellMin + 2.0 * static_cast<double>(cellSize);
+    if (glm::any(glm::lessThan(optimum, cellMin)) || glm::any(glm::greaterThan(optimum, cellMax)))
+        return glm::vec3(mean);
+
+    return glm::vec3(optimum);
+}
+
+void SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, float cellSize,
+    std::vector<Vertex>& simplifiedVertices, std::vector<GLuint>& simplifiedIndices)
+{
+    simplifiedVertices.clear();
+    simplifiedIndices.clear();
+
+    if (vertices.empty() || cellSize <= 0.0f)
+    {
+        simplifiedVertices = vertices;
+        simplifiedIndices = indices;
+        return;
+    }
+
+    glm::vec3 boundsMin(FLT_MAX);
+    for (const Vertex& vertex : vertices)
+        boundsMin = glm::min(boundsMin, vertex.position);
+
+    std::map<std::tuple<int, int, int, int, int>, unsigned int> clusterIndex;
+    std::vector<SimplifierCluster> clusters;
+    std::vector<unsigned int> clusterOf(vertices.size());
+
+    for (unsigned int i = 0; i < vertices.size(); ++i)
+    {
+        glm::ivec3 cell = glm::ivec3(glm::floor((vertices[i].position - boundsMin) / cellSize));
+        glm::ivec2 region = glm::ivec2(glm::floor(vertices[i].textureUV * uvRegions));
+        auto key = std::make_tuple(cell.x, cell.y, cell.z, region.x, region.y);
+
+        auto found = clusterIndex.find(key);
+        if (found == clusterIndex.end())
+        {
+            SimplifierCluster cluster;
+            cluster.firstVertex = i;
+            cluster.cell = cell;
+            found = clusterIndex.emplace(key, static_cast<unsigned int>(clusters.size())).first;
+            clusters.push_back(cluster);
+        }
+
+        SimplifierCluster& cluster = clusters[found->second];
+        cluster.positionSum += glm::dvec3(vertices[i].position);
+        cluster.vertexCount++;
+        clusterOf[i] = found->second;
+    }
+
+    // Every triangle adds its area weighted plane to the clusters of its corners
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        glm::dvec3 p0(vertices[indices[i]].position);
+        glm::dvec3 p1(vertices[indices[i + 1]].position);
+        glm::dvec3 p2(vertices[indices[i + 2]].position);
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double doubleArea = glm::length(normal);
+        if (doubleArea == 0.0)
+            continue;
+
+        normal /= doubleArea;
+        glm::dvec4 plane(normal, -glm::dot(normal, p0));
+
+        for (int corner = 0; corner < 3; ++corner)
+            AddPlane(clusters[clusterOf[indices[i + corner]]], plane, 0.5 * doubleArea);
+    }
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        unsigned int corners[3] = { clusterOf[indices[i]], clusterOf[indices[i + 1]], clusterOf[indices[i + 2]] };
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2])
+            continue;
+
+        for (unsigned int corner : corners)
+        {
+            SimplifierCluster& cluster = clusters[corner];
+            if (cluster.output < 0)
+            {
+                Vertex vertex = vertices[cluster.firstVertex];
+                vertex.position = ClusterPosition(cluster, boundsMin, cellSize);
+                cluster.output = static_cast<int>(simplifiedVertices.size());
+                simplifiedVertices.push_back(vertex);
+            }
+            simplifiedIndices.push_back(static_cast<GLuint>(cluster.output));
+        }
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glad/glad.h>
+#include <vector>
+#include "VBO.h"
+
+// Vertex clustering with one quadric error metric per cluster (Lindstrom, "Out-of-core simplification of large polygonal models").
+// Vertices are merged per cellSize grid cell and texture region, every cluster moves to the point closest to the planes of its
+// triangles, and triangles that collapse are dropped. Attributes other than the position come from the first vertex of a cluster.
+void SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, float cellSize,
+    std::vector<Vertex>& simplifiedVertices, std::vector<GLuint>& simplifiedIndices);
+
+#endif
@@ -1,28 +1,118 @@
 #include "Model.h"
+#include "MeshSimplifier.h"
+#include "AssetLoader.h"
+#include "AccessorView.h"
+#include <cmath>
 #include <iostream>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
 
-Model::Model(const std::string& filePath, unsigned int instancing, std::vector<glm::mat4> instanceMatrix) {
+std::map<std::string, std::weak_ptr<ModelAsset>> Model::assetCache;
+unsigned int Model::assetCacheHits = 0;
+
+Model::Model(const std::string& filePath, unsigned int instancing, std::vector<InstanceData> instances) {
     Model::filePath = filePath;
     Model::instancing = instancing;
-    Model::instanceMatrix = instanceMatrix;
+    Model::instances = instances;
+
+    // Instanced models fill their own instance buffers, so only plain models share an asset
+    if (instancing == 1) {
+        auto cached = assetCache.find(filePath);
+        if (cached != assetCache.end() && !cached->second.expired()) {
+            asset = cached->second.lock();
+            assetCacheHits++;
+
+            meshes = asset->meshes;
+            matricesMeshes = asset->matricesMeshes;
+            animationChannels = asset->animationChannels;
+            animationDuration = asset->animationDuration;
+            boundingRadius = asset->boundingRadius;
+
+            std::cout << "Reusing cached GLTF model: " << filePath << std::endl;
+            return;
+        }
+    }
 
     LoadModel(filePath);
+
+    if (instancing == 1 && !meshes.empty()) {
+        asset = std::make_shared<ModelAsset>();
+        asset->meshes = meshes;
+        asset->matricesMeshes = matricesMeshes;
+        asset->animationChannels = animationChannels;
+        asset->animationDuration = animationDuration;
+        asset->boundingRadius = boundingRadius;
+        assetCache[filePath] = asset;
+
+        // The parsed file is not needed once the meshes exist
+        model = tinygltf::Model();
+    }
+}
+
+void Model::MakeUnique() {
+    if (!asset) return;
+
+    // The only user takes the buffers over, later Models of the path load the file again
+    if (asset.use_count() == 1 && !asset->meshesReleased) {
+        assetCache.erase(filePath);
+        asset.reset();
+        return;
+    }
+
+    for (auto& mesh : meshes) {
+        std::vector<Vertex> vertices = mesh.vertices;
+        std::vector<GLuint> indices = mesh.indices;
+        std::vector<Texture> textures = mesh.textures;
+        mesh = Mesh(vertices, indices, textures, instancing, instances);
+    }
+
+    asset.reset();
+}
+
+void Model::Delete() {
+    for (auto& lod : lods) {
+        for (auto& mesh : lod.meshes) {
+            mesh.Delete();
+        }
+    }
+    lods.clear();
+
+    // Batched meshes already gave their buffers to the batch, shared ones are freed by whichever user is deleted last
+    bool ownsMeshes = asset ? asset.use_count() == 1 && !asset->meshesReleased : batch == nullptr;
+    if (ownsMeshes) {
+        for (auto& mesh : meshes) {
+            mesh.Delete();
+        }
+    }
+    meshes.clear();
+
+    asset.reset();
+    batch = nullptr;
+    batchRanges.clear();
+}
+
+size_t Model::GetCachedAssetCount() {
+    size_t count = 0;
+    for (const auto& entry : assetCache) {
+        if (!entry.second.expired()) count++;
+    }
+    return count;
 }
 
 void Model::LoadModel(const std::string& filePath) {
-    tinygltf::TinyGLTF loader;
     std::string err, warn;
+    GltfMapping mapping;
 
-    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, filePath);
+    bool ret = AssetLoader::LoadGltfFile(filePath, model, mapping, err, warn);
     if (!ret) {
         std::cerr << "Failed to load GLTF model: " << filePath << "\nError: " << err << "\nWarning: " << warn << std::endl;
         return;
     }
     std::cout << "Successfully loaded GLTF model: " << filePath << std::endl;
+    buffers = mapping.buffers;
 
     if (!model.scenes.empty() && model.defaultScene >= 0) {
         const tinygltf::Scene& scene = model.scenes[model.defaultScene];
@@ -38,35 +128,15 @@ void Model::LoadModel(const std::string& filePath) {
             AnimationChannel animChannel;
             animChannel.nodeIndex = channel.target_node;
             const auto& sampler = anim.samplers[channel.sampler];
-            const auto& inputAccessor = model.accessors[sampler.input];
-            const auto& outputAccessor = model.accessors[sampler.output];
-
-            std::vector<float> times;
-            {
-                const auto& bufferView = model.bufferViews[inputAccessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-                const unsigned char* dataPtr = buffer.data.data() + bufferView.byteOffset + inputAccessor.byteOffset;
-                const float* floatData = reinterpret_cast<const float*>(dataPtr);
-                times.assign(floatData, floatData + inputAccessor.count);
-            }
-
-            std::vector<float> translations;
-            {
-                const auto& bufferView = model.bufferViews[outputAccessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-                const unsigned char* dataPtr = buffer.data.data() + bufferView.byteOffset + outputAccessor.byteOffset;
-                const float* floatData = reinterpret_cast<const float*>(dataPtr);
-                translations.assign(floatData, floatData + outputAccessor.count * 3);
-            }
+            AccessorView times(model, model.accessors[sampler.input], &buffers);
+            AccessorView translations(model, model.accessors[sampler.output], &buffers);
 
-            for (size_t i = 0; i < times.size(); ++i) {
+            size_t keyframeCount = std::min(times.GetCount(), translations.GetCount());
+            animChannel.keyframes.reserve(keyframeCount);
+            for (size_t i = 0; i < keyframeCount; ++i) {
                 Keyframe kf;
-                kf.time = times[i];
-                kf.translation = glm::vec3(
-                    translations[i * 3],
-                    translations[i * 3 + 1],
-                    translations[i * 3 + 2]
-                );
+                kf.time = times.GetComponent(i, 0);
+                kf.translation = translations.GetVec3(i);
                 animChannel.keyframes.push_back(kf);
             }
 
@@ -81,6 +151,12 @@ void Model::LoadModel(const std::string& filePath) {
     }
 
     std::cout << "Loaded " << animationChannels.size() << " animation channels." << std::endl;
+
+    // Everything read from the buffers now lives in the meshes and keyframes
+    buffers.clear();
+    mapping.Close();
+    model.buffers.clear();
+    model.buffers.shrink_to_fit();
 }
 
 void Model::ProcessNode(const tinygltf::Node& node, const glm::mat4& parentTransform) {
@@ -120,29 +196,32 @@ void Model::ProcessMesh(const tinygltf::Mesh& gltfMesh, const glm::mat4& transfo
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
 
+        // The vertices are sized once and every attribute is written into them straight from the glTF buffer
         if (primitive.attributes.find("POSITION") != primitive.attributes.end()) {
-            const auto& accessor = model.accessors[primitive.attributes.at("POSITION")];
-            const auto& positionData = GetAttributeData(accessor);
-
-            for (size_t i = 0; i < accessor.count; ++i) {
-                Vertex vertex;
-                vertex.position = glm::vec3(positionData[i * 3], positionData[i * 3 + 1], positionData[i * 3 + 2]);
-                vertex.normal = glm::vec3(1.0f); 
-                vertex.color = glm::vec3(1.0f);  
-                vertex.textureUV = glm::vec2(0.0f);
-                vertex.height = 0.0f;
-                vertices.push_back(vertex);
+            AccessorView positions(model, model.accessors[primitive.attributes.at("POSITION")], &buffers);
+
+            Vertex defaultVertex;
+            defaultVertex.position = glm::vec3(0.0f);
+            defaultVertex.normal = glm::vec3(1.0f);
+            defaultVertex.color = glm::vec3(1.0f);
+            defaultVertex.textureUV = glm::vec2(0.0f);
+            defaultVertex.height = 0.0f;
+            vertices.assign(positions.GetCount(), defaultVertex);
+
+            float radiusSquared = boundingRadius * boundingRadius;
+            for (size_t i = 0; i < vertices.size(); ++i) {
+                vertices[i].position = positions.GetVec3(i);
+                radiusSquared = std::max(radiusSquared, glm::dot(vertices[i].position, vertices[i].position));
             }
+            boundingRadius = std::sqrt(radiusSquared);
         }
 
         if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-            const auto& accessor = model.accessors[primitive.attributes.at("TEXCOORD_0")];
-            const auto& texCoordData = GetAttributeData(accessor);
+            AccessorView texCoords(model, model.accessors[primitive.attributes.at("TEXCOORD_0")], &buffers);
 
-            for (size_t i = 0; i < accessor.count; ++i) {
-                vertices[i].textureUV = glm::vec2(
-                    texCoordData[i * 2], texCoordData[i * 2 + 1]
-                );
+            size_t texCoordCount = std::min(texCoords.GetCount(), vertices.size());
+            for (size_t i = 0; i < texCoordCount; ++i) {
+                vertices[i].textureUV = texCoords.GetVec2(i);
             }
         }
 
@@ -160,73 +239,192 @@ void Model::ProcessMesh(const tinygltf::Mesh& gltfMesh, const glm::mat4& transfo
                     const auto& texture = model.textures[textureIndex];
                     const auto& image = model.images[texture.source];
 
-                    std::string modelDirectory = filePath.substr(0, filePath.find_last_of('/') + 1);
-                    std::string texturePath = modelDirectory + image.uri;
-                    std::cout << "Loading texture: " << texturePath << std::endl;
-
-                    textures.emplace_back(Texture(texturePath.c_str(), "diffuse", 0));
+                    if (image.uri.empty() && image.bufferView >= 0) {
+                        // Images embedded in a .glb are encoded bytes inside a buffer view
+                        const auto& bufferView = model.bufferViews[image.bufferView];
+                        const BufferSpan& buffer = buffers[bufferView.buffer];
+                        std::string cacheName = filePath + "#image" + std::to_string(texture.source);
+                        std::cout << "Loading embedded texture: " << cacheName << std::endl;
+
+                        if (bufferView.byteOffset + bufferView.byteLength <= buffer.size)
+                            textures.emplace_back(Texture(buffer.data + bufferView.byteOffset, bufferView.byteLength, cacheName.c_str(), "diffuse", 0));
+                    }
+                    else {
+                        std::string modelDirectory = filePath.substr(0, filePath.find_last_of('/') + 1);
+                        std::string texturePath = modelDirectory + image.uri;
+                        std::cout << "Loading texture: " << texturePath << std::endl;
+
+                        textures.emplace_back(Texture(texturePath.c_str(), "diffuse", 0));
+                    }
                 }
             }
         }
 
-        meshes.emplace_back(vertices, indices, textures, instancing, instanceMatrix);
+        meshes.emplace_back(vertices, indices, textures, instancing, instances);
         matricesMeshes.emplace_back(transform);
     }
 }
 
-std::vector<float> Model::GetAttributeData(const tinygltf::Accessor& accessor) {
-    std::vector<float> result;
-    const auto& bufferView = model.bufferViews[accessor.bufferView];
-    const auto& buffer = model.buffers[bufferView.buffer];
-    const unsigned char* data = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
+std::vector<GLuint> Model::GetIndices(const tinygltf::Accessor& accessor) {
+    AccessorView view(model, accessor, &buffers);
 
-    size_t count = accessor.count;
-    size_t stride = 1;
-    switch (accessor.type) {
-    case TINYGLTF_TYPE_SCALAR: stride = 1; break;
-    case TINYGLTF_TYPE_VEC2: stride = 2; break;
-    case TINYGLTF_TYPE_VEC3: stride = 3; break;
-    case TINYGLTF_TYPE_VEC4: stride = 4; break;
-    default: stride = 1; break;
+    std::vector<GLuint> indices(view.GetCount());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        indices[i] = view.GetIndex(i);
     }
 
-    for (size_t i = 0; i < count * stride; ++i) {
-        result.push_back(static_cast<const float*>(reinterpret_cast<const void*>(data))[i]);
+    return indices;
+}
+
+void Model::Draw(Shader& shader, Camera& camera, glm::mat4 modelMatrix) {
+    if (batch) {
+        for (size_t i = 0; i < batchRanges.size(); ++i) {
+            batch->Submit(batchRanges[i], modelMatrix * matricesMeshes[i]);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        glm::mat4 finalModel = modelMatrix * matricesMeshes[i];
+        meshes[i].Draw(shader, camera, finalModel);
     }
 
-    return result;
+    // One instanced draw per level and mesh, levels without instances in their bucket draw nothing
+    for (auto& lod : lods) {
+        for (size_t i = 0; i < lod.meshes.size(); ++i) {
+            if (lod.meshes[i].instancing == 0) continue;
+            lod.meshes[i].Draw(shader, camera, modelMatrix * lod.matricesMeshes[i]);
+        }
+    }
 }
 
-std::vector<GLuint> Model::GetIndices(const tinygltf::Accessor& accessor) {
-    std::vector<GLuint> indices;
-    const auto& bufferView = model.bufferViews[accessor.bufferView];
-    const auto& buffer = model.buffers[bufferView.buffer];
-    const unsigned char* data = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
-
-    for (size_t i = 0; i < accessor.count; ++i) {
-        switch (accessor.componentType) {
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-            indices.push_back(static_cast<const GLuint*>(reinterpret_cast<const void*>(data))[i]);
-            break;
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-            indices.push_back(static_cast<const GLushort*>(reinterpret_cast<const void*>(data))[i]);
-            break;
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-            indices.push_back(static_cast<const GLubyte*>(reinterpret_cast<const void*>(data))[i]);
-            break;
-        default:
-            indices.push_back(0);
-            break;
+void Model::Batch(MeshBatch& targetBatch) {
+    if (instancing != 1 || !lods.empty()) {
+        std::cerr << "Only models without instancing or LODs can be batched: " << filePath << std::endl;
+        return;
+    }
+    if (batch == &targetBatch) return;
+
+    batch = &targetBatch;
+    batchRanges.clear();
+
+    // Copies of a cached asset are added once, the shared buffers stay alive until every user is batched
+    if (asset) {
+        if (asset->batch != batch) {
+            asset->batch = batch;
+            asset->batchRanges.clear();
+            asset->batchedUsers = 0;
+            for (const auto& mesh : meshes) {
+                asset->batchRanges.push_back(batch->Add(mesh.vertices, mesh.indices, mesh.textures));
+            }
+        }
+        batchRanges = asset->batchRanges;
+
+        asset->batchedUsers++;
+        if (static_cast<long>(asset->batchedUsers) == asset.use_count() && !asset->meshesReleased) {
+            for (auto& mesh : asset->meshes) {
+                mesh.Delete();
+            }
+            asset->meshesReleased = true;
+
+            // Models constructed from now on load the file again instead of sharing the released buffers
+            auto cached = assetCache.find(filePath);
+            if (cached != assetCache.end() && cached->second.lock() == asset) {
+                assetCache.erase(cached);
+            }
         }
+        return;
     }
 
-    return indices;
+    // The Mesh objects keep their CPU data for GetTriangleCount, only the GL buffers are released
+    for (auto& mesh : meshes) {
+        batchRanges.push_back(batch->Add(mesh.vertices, mesh.indices, mesh.textures));
+        mesh.Delete();
+    }
 }
 
-void Model::Draw(Shader& shader, Camera& camera, glm::mat4 modelMatrix) {
-    for (size_t i = 0; i < meshes.size(); ++i) {
-        glm::mat4 finalModel = modelMatrix * matricesMeshes[i];
-        meshes[i].Draw(shader, camera, finalModel);
+void Model::AddSimplifiedLod(float distance, float cellSize) {
+    MakeUnique();
+
+    ModelLod lod;
+    lod.distance = distance;
+    lod.matricesMeshes = matricesMeshes;
+
+    for (const auto& mesh : meshes) {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        SimplifyMesh(mesh.vertices, mesh.indices, cellSize, vertices, indices);
+
+        // Clusters can move slightly outside the original surface
+        for (const Vertex& vertex : vertices) {
+            boundingRadius = std::max(boundingRadius, glm::length(vertex.position));
+        }
+
+        std::vector<Texture> textures = mesh.textures;
+        lod.meshes.emplace_back(vertices, indices, textures, 0);
+    }
+
+    lods.push_back(lod);
+    std::sort(lods.begin(), lods.end(), [](const ModelLod& a, const ModelLod& b) { return a.distance < b.distance; });
+}
+
+size_t Model::GetBatchedTriangleCount() const {
+    size_t triangles = 0;
+    for (unsigned int range : batchRanges) {
+        triangles += batch->GetTriangleCount(range);
+    }
+    return triangles;
+}
+
+size_t Model::GetTriangleCount(size_t lod) const {
+    const std::vector<Mesh>& levelMeshes = lod == 0 ? meshes : lods[lod - 1].meshes;
+
+    size_t triangles = 0;
+    for (const auto& mesh : levelMeshes) {
+        triangles += mesh.indices.size() / 3;
+    }
+    return triangles;
+}
+
+void Model::UpdateLodInstances(const std::vector<InstanceData>& newInstances, glm::vec3 viewPosition) {
+    MakeUnique();
+
+    if (lods.empty()) {
+        UpdateInstances(static_cast<unsigned int>(newInstances.size()), newInstances);
+        return;
+    }
+
+    std::vector<float> squaredDistances;
+    for (auto& lod : lods) {
+        squaredDistances.push_back(lod.distance * lod.distance);
+        lod.instances.clear();
+    }
+
+    // instances holds the bucket of the full meshes
+    instances.clear();
+    for (const InstanceData& instance : newInstances) {
+        glm::vec3 delta = instance.position - viewPosition;
+        float squaredDistance = glm::dot(delta, delta);
+
+        size_t level = 0;
+        while (level < lods.size() && squaredDistance >= squaredDistances[level])
+            ++level;
+
+        if (level == 0)
+            instances.push_back(instance);
+        else
+            lods[level - 1].instances.push_back(instance);
+    }
+
+    instancing = static_cast<unsigned int>(instances.size());
+    for (auto& mesh : meshes) {
+        mesh.UpdateInstances(instancing, instances);
+    }
+
+    for (auto& lod : lods) {
+        for (auto& mesh : lod.meshes) {
+            mesh.UpdateInstances(static_cast<unsigned int>(lod.instances.size()), lod.instances);
+        }
     }
 }
 
@@ -268,13 +466,35 @@ void Model::UpdateAnimation(float currentTime) {
     }
 }
 
-void Model::UpdateInstances(unsigned int newInstancing, std::vector<glm::mat4> newInstanceMatrix)
+void Model::UpdateInstances(unsigned int newInstancing, const std::vector<InstanceData>& newInstances)
 {
-    Model::instancing = instancing;
-    Model::instanceMatrix = instanceMatrix;
+    MakeUnique();
+
+    // The meshes keep the instances on the GPU, so no CPU copy is stored here
+    Model::instancing = newInstancing;
 
     for (auto& mesh : meshes)
     {
-        mesh.UpdateInstanceMatrix(newInstancing, newInstanceMatrix);
+        mesh.UpdateInstances(newInstancing, newInstances);
     }
-}
\ No newline at end of file
+
+    // Lower levels are only filled by UpdateLodInstances
+    for (auto& lod : lods)
+    {
+        lod.instances.clear();
+        for (auto& mesh : lod.meshes)
+        {
+            mesh.UpdateInstances(0, lod.instances);
+        }
+    }
+}
+
+void Model::UpdateInstanceRange(unsigned int first, unsigned int count, const InstanceData* newInstances)
+{
+    MakeUnique();
+
+    for (auto& mesh : meshes)
+    {
+        mesh.UpdateInstanceRange(first, count, newInstances);
+    }
+}
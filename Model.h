@@ -3,11 +3,15 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <memory>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <tinygltf/tiny_gltf.h>
 #include "Mesh.h"
+#include "MeshBatch.h"
+#include "AccessorView.h"
 
 struct Keyframe {
     float time;
@@ -19,32 +23,99 @@ struct AnimationChannel {
     std::vector<Keyframe> keyframes;
 };
 
+// Lower detail meshes drawn for instances at least distance away
+struct ModelLod {
+    float distance;
+    std::vector<Mesh> meshes;
+    std::vector<glm::mat4> matricesMeshes;
+    std::vector<InstanceData> instances;
+};
+
+// Meshes and animation of one glTF file, loaded once and shared by every non-instanced Model of that path.
+// The meshes are handles, so the copies in each Model use the same GL buffers and textures.
+struct ModelAsset {
+    std::vector<Mesh> meshes;
+    std::vector<glm::mat4> matricesMeshes;
+    std::vector<AnimationChannel> animationChannels;
+    float animationDuration = 0.0f;
+    float boundingRadius = 0.0f;
+
+    // Ranges of the meshes in the batch the first batched user added them to
+    MeshBatch* batch = nullptr;
+    std::vector<unsigned int> batchRanges;
+    // Once every user draws from the batch the meshes' own GL buffers are freed, only their CPU data is left
+    unsigned int batchedUsers = 0;
+    bool meshesReleased = false;
+};
+
 class Model {
 public:
-    Model(const std::string& filePath, unsigned int instancing = 1, std::vector<glm::mat4> instanceMatrix = {});
+    Model(const std::string& filePath, unsigned int instancing = 1, std::vector<InstanceData> instances = {});
+    // Frees the GL buffers of the model, the shared meshes of a cached asset only once its last user is deleted
+    void Delete();
+    // Once batched, Draw only queues the meshes and the batch's Draw issues them
     void Draw(Shader& shader, Camera& camera, glm::mat4 model = glm::mat4(1.0f));
 
+    // Moves the meshes of a non-instanced model into the shared buffers of batch and frees their own
+    void Batch(MeshBatch& batch);
+
     void UpdateAnimation(float currentTime);
-    void UpdateInstances(unsigned int newInstancing, std::vector<glm::mat4> newInstanceMatrix);
+    void UpdateInstances(unsigned int newInstancing, const std::vector<InstanceData>& newInstances);
+    // Overwrites instances [first, first + count) in place, the instance count stays the same
+    void UpdateInstanceRange(unsigned int first, unsigned int count, const InstanceData* newInstances);
+
+    // Radius around the model origin that holds every vertex, used to cull instances
+    float GetBoundingRadius() const { return boundingRadius; }
+
+    // Adds a level simplified from the full meshes by clustering vertices in cells of cellSize model units
+    void AddSimplifiedLod(float distance, float cellSize);
+    size_t GetLodCount() const { return lods.size() + 1; }
+    size_t GetTriangleCount(size_t lod) const;
+    // Triangles the batch draws for this model, equal to GetTriangleCount(0) when it was batched whole
+    size_t GetBatchedTriangleCount() const;
+
+    // Buckets the instances by distance to viewPosition, given in the same space as their positions, and uploads every level's bucket.
+    // UpdateInstances and UpdateInstanceRange only feed the full meshes.
+    void UpdateLodInstances(const std::vector<InstanceData>& newInstances, glm::vec3 viewPosition);
+
+    // Number of distinct files behind the cached models, and Models constructed from the cache instead of the file
+    static size_t GetCachedAssetCount();
+    static unsigned int GetAssetCacheHits() { return assetCacheHits; }
 
 private:
     std::string filePath;
     unsigned int instancing;
 
     tinygltf::Model model;
+    // Bytes of every buffer of the model while LoadModel runs, mapped buffers are empty in the model itself
+    std::vector<BufferSpan> buffers;
     std::vector<Mesh> meshes;
 
     std::vector<glm::mat4> matricesMeshes;
-    std::vector<glm::mat4> instanceMatrix;
+    std::vector<InstanceData> instances;
+    float boundingRadius = 0.0f;
+
+    MeshBatch* batch = nullptr;
+    std::vector<unsigned int> batchRanges;
+
+    // Set while the meshes are the shared ones of a cached asset, per Model state like the mesh matrices is copied.
+    // Copies of a Model hold the asset too, so its use count is the number of users.
+    std::shared_ptr<ModelAsset> asset;
+    static std::map<std::string, std::weak_ptr<ModelAsset>> assetCache;
+    static unsigned int assetCacheHits;
+
+    // Sorted by distance, level 0 are the full meshes above
+    std::vector<ModelLod> lods;
 
     std::vector<AnimationChannel> animationChannels;
     float animationDuration = 0.0f;
 
     void LoadModel(const std::string& filePath);
+    // Gives the model its own GL buffers before it changes them, other users of the asset keep the shared ones
+    void MakeUnique();
     void ProcessNode(const tinygltf::Node& node, const glm::mat4& parentTransform);
     void ProcessMesh(const tinygltf::Mesh& gltfMesh, const glm::mat4& transform);
 
-    std::vector<float> GetAttributeData(const tinygltf::Accessor& accessor);
     std::vector<GLuint> GetIndices(const tinygltf::Accessor& accessor);
 };
 
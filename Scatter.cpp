@@ -0,0 +1,151 @@
+#include "Scatter.h"
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+static unsigned int Hash(unsigned int value)
+{
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+    return value;
+}
+
+static unsigned int HashPoint(int tileX, int tileZ, unsigned int point, unsigned int seed)
+{
+    return Hash(Hash(Hash(Hash(seed) ^ static_cast<unsigned int>(tileX)) ^ static_cast<unsigned int>(tileZ)) ^ point);
+}
+
+static float HashToUnit(unsigned int hash)
+{
+    return (hash >> 8) * (1.0f / 16777216.0f);
+}
+
+Scatter::Scatter(Field height, Field density, float slopeStep, unsigned int seed)
+    : height(height), density(density), slopeStep(slopeStep), pointRadius(0.1f)
+{
+    GeneratePoints(seed);
+}
+
+void Scatter::GeneratePoints(unsigned int seed)
+{
+    // Bridson's dart throwing on a torus, distances wrap around the tile edges so copies of the tile fit together
+    const int attempts = 30;
+    int cells = static_cast<int>(std::ceil(std::sqrt(2.0f) / pointRadius));
+    float radiusSquared = pointRadius * pointRadius;
+
+    std::vector<int> grid(cells * cells, -1);
+    std::vector<unsigned int> active;
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    auto cellOf = [&](glm::vec2 point) { return glm::ivec2(std::min(static_cast<int>(point.x * cells), cells - 1), std::min(static_cast<int>(point.y * cells), cells - 1)); };
+
+    auto fits = [&](glm::vec2 candidate)
+    {
+        glm::ivec2 cell = cellOf(candidate);
+        for (int dz = -2; dz <= 2; ++dz)
+        {
+            for (int dx = -2; dx <= 2; ++dx)
+            {
+                int index = grid[((cell.y + dz + cells) % cells) * cells + (cell.x + dx + cells) % cells];
+                if (index < 0)
+                    continue;
+
+                glm::vec2 delta = glm::abs(points[index] - candidate);
+                delta = glm::min(delta, glm::vec2(1.0f) - delta);
+                if (glm::dot(delta, delta) < radiusSquared)
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    auto add = [&](glm::vec2 point)
+    {
+        glm::ivec2 cell = cellOf(point);
+        grid[cell.y * cells + cell.x] = static_cast<int>(points.size());
+        active.push_back(static_cast<unsigned int>(points.size()));
+        points.push_back(point);
+    };
+
+    add(glm::vec2(unit(random), unit(random)));
+
+    while (!active.empty())
+    {
+        size_t slot = static_cast<size_t>(unit(random) * active.size()) % active.size();
+        glm::vec2 origin = points[active[slot]];
+        bool placed = false;
+
+        for (int attempt = 0; attempt < attempts && !placed; ++attempt)
+        {
+            float angle = unit(random) * 6.28318530718f;
+            float distance = pointRadius * (1.0f + unit(random));
+            glm::vec2 candidate = origin + distance * glm::vec2(std::cos(angle), std::sin(angle));
+            candidate -= glm::floor(candidate);
+
+            if (fits(candidate))
+            {
+                add(candidate);
+                placed = true;
+            }
+        }
+
+        if (!placed)
+        {
+            active[slot] = active.back();
+            active.pop_back();
+        }
+    }
+}
+
+float Scatter::GetTileSize(const ScatterSpecies& species) const
+{
+    // The tile's point spacing becomes the species radius
+    return species.radius / pointRadius;
+}
+
+void Scatter::GenerateTile(const ScatterSpecies& species, int tileX, int tileZ, std::vector<InstanceData>& instances) const
+{
+    float tileSize = GetTileSize(species);
+    float minSlopeNormal = std::cos(glm::radians(species.maxSlope));
+
+    instances.clear();
+
+    for (unsigned int i = 0; i < points.size(); ++i)
+    {
+        glm::vec2 world = (glm::vec2(static_cast<float>(tileX), static_cast<float>(tileZ)) + points[i]) * tileSize;
+        unsigned int hash = HashPoint(tileX, tileZ, i, species.seed);
+
+        float keep = species.density;
+        if (species.densityMapScale > 0.0f)
+            keep *= glm::clamp(0.5f + 0.5f * density(world.x * species.densityMapScale, world.y * species.densityMapScale), 0.0f, 1.0f);
+
+        if (HashToUnit(hash) >= keep)
+            continue;
+
+        float groundHeight = height(world.x, world.y);
+        if (groundHeight < species.minHeight || groundHeight > species.maxHeight)
+            continue;
+
+        if (species.maxSlope < 90.0f)
+        {
+            float left = height(world.x - slopeStep, world.y);
+            float right = height(world.x + slopeStep, world.y);
+            float down = height(world.x, world.y - slopeStep);
+            float up = height(world.x, world.y + slopeStep);
+            glm::vec3 normal = glm::normalize(glm::vec3(left - right, 2.0f * slopeStep, down - up));
+
+            if (normal.y < minSlopeNormal)
+                continue;
+        }
+
+        unsigned int rotationHash = Hash(hash);
+        float yaw = HashToUnit(rotationHash) * 6.28318530718f;
+        float scale = species.sizeScale * (1.0f + species.scaleVariation * (2.0f * HashToUnit(Hash(rotationHash)) - 1.0f));
+
+        instances.push_back(InstanceData(glm::vec3(world.x, groundHeight + species.modelYOffset, world.y), scale, yaw));
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include <glm/glm.hpp>
+#include "VBO.h"
+#include <functional>
+#include <vector>
+#include <cfloat>
+
+struct ScatterSpecies {
+    float radius = 1.0f;            // Minimum distance between two instances in world units
+    float density = 1.0f;           // Fraction of the Poisson points kept where the density map is 1
+    float densityMapScale = 0.0f;   // Frequency multiplier of the density map (0 = uniform density)
+    float minHeight = -FLT_MAX;
+    float maxHeight = FLT_MAX;
+    float maxSlope = 90.0f;         // Steepest ground in degrees
+    float sizeScale = 1.0f;
+    float scaleVariation = 0.0f;    // Instances are scaled by sizeScale * [1 - scaleVariation, 1 + scaleVariation]
+    float modelYOffset = 0.0f;
+    unsigned int seed = 0;          // Species with different seeds keep different subsets of the same points
+};
+
+// Scatters instances from one precomputed Poisson-disk point set that tiles the plane without seams.
+// Tiles sit on a fixed world grid and every decision is hashed from the tile and point index,
+// so a tile always produces the same instances and callers can cache them per tile.
+class Scatter {
+public:
+    typedef std::function<float(float, float)> Field;
+
+    // height(worldX, worldZ) is the ground height, density(x, z) returns roughly [-1, 1] and is remapped to [0, 1]
+    Scatter(Field height, Field density, float slopeStep, unsigned int seed = 1);
+
+    // World size of one tile, tile (x, z) covers [x, x + 1) * tileSize by [z, z + 1) * tileSize
+    float GetTileSize(const ScatterSpecies& species) const;
+
+    // World-space instances of one tile, the result only depends on the species and the tile coordinate
+    void GenerateTile(const ScatterSpecies& species, int tileX, int tileZ, std::vector<InstanceData>& instances) const;
+
+    size_t GetPointCount() const { return points.size(); }
+
+private:
+    Field height;
+    Field density;
+    float slopeStep;
+
+    // Points in [0, 1)² at least pointRadius apart, also across the tile edges
+    std::vector<glm::vec2> points;
+    float pointRadius;
+
+    void GeneratePoints(unsigned int seed);
+};
+
+#endif
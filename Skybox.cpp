@@ -1,4 +1,5 @@
 #include "skybox.h"
+#include "AssetLoader.h"
 
 float skyboxVertices[] = {
     // Positions          // UVs
@@ -92,7 +93,7 @@ Skybox::Skybox()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     int texWidth, texHeight, nrChannels;
-    unsigned char* data = stbi_load("Textures/Skybox.png", &texWidth, &texHeight, &nrChannels, 0);
+    unsigned char* data = AssetLoader::LoadImageFile("Textures/Skybox.png", &texWidth, &texHeight, &nrChannels);
 
     if (data)
     {
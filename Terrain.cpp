@@ -2,65 +2,169 @@
 #include <iostream>
 #include <algorithm>
 #include <set>
+#include <chrono>
+#include <cmath>
+#include <limits>
 
-Terrain::Terrain(float size, unsigned int resolution, float heightScale, float noiseFrequency, int octaves, float lacunarity, float gain)
-    : size(size), resolution(resolution), heightScale(heightScale), noiseFrequency(noiseFrequency), octaves(octaves), lacunarity(lacunarity), gain(gain), terrainMesh(nullptr)
+Terrain::Terrain(float size, unsigned int resolution, float heightScale, float noiseFrequency, int octaves, float lacunarity, float gain, unsigned int chunkCount, bool gpuDisplacement)
+    : terrainMesh(nullptr), heightMap(nullptr), threadPool(new ThreadPool()), size(size), resolution(resolution), heightScale(heightScale), noiseFrequency(noiseFrequency), octaves(octaves), lacunarity(lacunarity), gain(gain), chunkCount(chunkCount), gpuDisplacement(gpuDisplacement && chunkCount == 0), noise(noiseFrequency, octaves, lacunarity, gain)
 {
-    noise.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
-    noise.SetFractalType(FastNoiseLite::FractalType_FBm);
-    noise.SetFractalOctaves(octaves);
-    noise.SetFrequency(noiseFrequency);
-    noise.SetFractalLacunarity(lacunarity);
-    noise.SetFractalGain(gain);
+    textures = { Texture("Textures/Grass1.jpg", "diffuse", 0), Texture("Textures/Grass2.jpg", "diffuse", 1) };
+    // Held for the chunk meshes built later, so evicting before the first UpdateTerrain keeps the grass
+    for (auto& texture : textures)
+        texture.AddReference();
+    Terrain::textureScale = size / 50;
 
-    GenerateTerrain(vertices, indices);
-    CalculateNormals(vertices, indices);
+    // The density map reads the terrain noise far away from the origin so it does not follow the hills
+    scatter = new Scatter(
+        [this](float worldX, float worldZ) { return SampleHeight(worldX, worldZ); },
+        [this](float x, float z) { return noise.GetNoise(x + 10000.0f, z - 10000.0f); },
+        GetGridStep()
+    );
 
-    std::vector <Texture> textures{ Texture("Textures/Grass1.jpg", "diffuse", 0), Texture("Textures/Grass2.jpg", "diffuse", 1) };
-    Terrain::textureScale = size / 50;
+    if (chunkCount > 0)
+    {
+        // Chunks keep the vertex spacing of the single mesh, rounded to a power of two cells so every LOD halves cleanly
+        chunkStep = size / (resolution - 1);
+        chunkCells = 2;
+        while (chunkCells * 3 < ((resolution - 1) / chunkCount) * 2)
+            chunkCells *= 2;
+
+        while ((chunkCells >> (maxLod + 1)) >= 4)
+            maxLod++;
+
+        // The first UpdateTerrain builds the chunks, after the caller had a chance to set the LOD distance
+        return;
+    }
+
+    GenerateTerrain(vertices);
+
+    // The displaced grid stays flat on the GPU, only the height map changes when the window moves
+    if (Terrain::gpuDisplacement)
+    {
+        heightMap = new HeightMap(3);
+        BuildHeightMap(heightMapData, 0.0f, 0.0f);
+        heightMap->Upload(heightMapData.data(), resolution + 2, resolution + 2);
+    }
+    else
+    {
+        BuildVertices(vertices, 0.0f, 0.0f);
+    }
 
-    terrainMesh = new Mesh(vertices, indices, textures);
+    const GridIndices& grid = GetGridIndices(resolution);
+    terrainMesh = new Mesh(vertices, *grid.ebo, grid.count, grid.type, textures);
+    backVertices = vertices;
 }
 
 Terrain::~Terrain()
 {
+    // GL objects are freed in Delete while the context is still current, only the CPU side is released here
+    if (pendingUpdate.valid())
+        pendingUpdate.wait();
+
+    delete terrainMesh;
+    delete heightMap;
+
+    for (auto& chunk : chunks)
+        delete chunk.second.mesh;
+
+    for (Mesh* mesh : freeChunkMeshes)
+        delete mesh;
+
+    for (auto& grid : gridIndices)
+        delete grid.second.ebo;
+
+    delete scatter;
+    scatter = nullptr;
+
+    delete threadPool;
+    threadPool = nullptr;
+}
+
+void Terrain::Delete()
+{
+    if (pendingUpdate.valid())
+        pendingUpdate.wait();
+
     if (terrainMesh)
     {
-        //terrainMesh->Delete();
+        terrainMesh->Delete();
         delete terrainMesh;
         terrainMesh = nullptr;
     }
+
+    if (heightMap)
+    {
+        heightMap->Delete();
+        delete heightMap;
+        heightMap = nullptr;
+    }
+
+    for (auto& chunk : chunks)
+    {
+        chunk.second.mesh->Delete();
+        delete chunk.second.mesh;
+    }
+    chunks.clear();
+
+    for (Mesh* mesh : freeChunkMeshes)
+    {
+        mesh->Delete();
+        delete mesh;
+    }
+    freeChunkMeshes.clear();
+
+    for (auto& grid : gridIndices)
+    {
+        grid.second.ebo->Delete();
+        delete grid.second.ebo;
+    }
+    gridIndices.clear();
+
+    for (auto& texture : textures)
+        texture.Delete();
+    textures.clear();
+}
+
+void Terrain::SetThreadCount(unsigned int threadCount)
+{
+    if (pendingUpdate.valid())
+        pendingUpdate.wait();
+
+    delete threadPool;
+    threadPool = new ThreadPool(threadCount);
 }
 
-void Terrain::GenerateTerrain(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+void Terrain::GenerateTerrain(std::vector<Vertex>& vertices)
 {
     float step = size / (resolution - 1);
     float halfSize = size / 2.0f;
 
+    // Only the fixed grid layout is set here, BuildVertices fills in the heightfield
     for (unsigned int z = 0; z < resolution; ++z)
     {
         for (unsigned int x = 0; x < resolution; ++x)
         {
             Vertex vertex;
-            vertex.position.x = -halfSize + x * step;
-            vertex.position.z = -halfSize + z * step;
-            vertex.position.y = noise.GetNoise(vertex.position.x, vertex.position.z) * heightScale;
-            vertex.textureUV = glm::vec2((vertex.position.x / size) * textureScale, (vertex.position.z / size) * textureScale);
+            vertex.position = glm::vec3(-halfSize + x * step, 0.0f, -halfSize + z * step);
+            vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f);
             vertex.color = glm::vec3(1.0f, 1.0f, 1.0f);
-            vertex.height = vertex.position.y;
-            vertex.normal = glm::vec3(0.0f, 0.0f, 0.0f);
+            vertex.textureUV = glm::vec2(0.0f);
+            vertex.height = 0.0f;
             vertices.push_back(vertex);
         }
     }
+}
 
-
-    for (unsigned int z = 0; z < resolution - 1; ++z)
+void Terrain::GenerateIndices(unsigned int gridResolution, std::vector<GLuint>& indices) const
+{
+    for (unsigned int z = 0; z < gridResolution - 1; ++z)
     {
-        for (unsigned int x = 0; x < resolution - 1; ++x)
+        for (unsigned int x = 0; x < gridResolution - 1; ++x)
         {
-            unsigned int topLeft = z * resolution + x;
+            unsigned int topLeft = z * gridResolution + x;
             unsigned int topRight = topLeft + 1;
-            unsigned int bottomLeft = (z + 1) * resolution + x;
+            unsigned int bottomLeft = (z + 1) * gridResolution + x;
             unsigned int bottomRight = bottomLeft + 1;
 
             indices.push_back(topLeft);
@@ -74,6 +178,41 @@ void Terrain::GenerateTerrain(std::vector<Vertex>& vertices, std::vector<GLuint>
     }
 }
 
+const GridIndices& Terrain::GetGridIndices(unsigned int gridResolution)
+{
+    // Grid topology only depends on the resolution, so it is uploaded once and reused by every heightfield update
+    auto grid = gridIndices.find(gridResolution);
+    if (grid != gridIndices.end())
+        return grid->second;
+
+    std::vector<GLuint> gridIndexData;
+    GenerateIndices(gridResolution, gridIndexData);
+
+    GridIndices created;
+    created.count = static_cast<GLsizei>(gridIndexData.size());
+
+    if (gridResolution * gridResolution <= 65536)
+    {
+        std::vector<GLushort> shortIndices(gridIndexData.begin(), gridIndexData.end());
+        created.ebo = new EBO(shortIndices);
+        created.type = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        created.ebo = new EBO(gridIndexData);
+        created.type = GL_UNSIGNED_INT;
+    }
+    created.ebo->Unbind();
+
+    return gridIndices.insert(std::make_pair(gridResolution, created)).first->second;
+}
+
+static glm::vec3 HeightfieldNormal(float left, float right, float down, float up, float step)
+{
+    // Central differences of y = h(x, z), the normal is (-dh/dx, 1, -dh/dz) scaled by 2 * step
+    return glm::normalize(glm::vec3(left - right, 2.0f * step, down - up));
+}
+
 void Terrain::CalculateNormals(std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
 {
     for (auto& vertex : vertices)
@@ -111,30 +250,50 @@ void Terrain::Draw(Shader& shader, Camera& camera, glm::mat4 model)
     shader.Activate();
     glUniform1i(glGetUniformLocation(shader.id, "blendTextures"), true);
 
-    terrainMesh->Draw(shader, camera, model);
+    if (chunkCount > 0)
+    {
+        // Chunk vertices are stored relative to the chunk corner, which is placed relative to the current terrain offset
+        for (auto& chunk : chunks)
+        {
+            float originX = chunk.first.first * GetChunkSize() - offsetX;
+            float originZ = chunk.first.second * GetChunkSize() - offsetZ;
+
+            chunk.second.mesh->Draw(shader, camera, glm::translate(model, glm::vec3(originX, 0.0f, originZ)));
+        }
+    }
+    else
+    {
+        if (heightMap)
+        {
+            float step = GetGridStep();
+            glm::vec2 origin = GetHeightMapOrigin(offsetX, offsetZ);
+
+            heightMap->Bind(shader, "heightMap");
+            glUniform1i(glGetUniformLocation(shader.id, "gridResolution"), resolution);
+            glUniform1f(glGetUniformLocation(shader.id, "gridStep"), step);
+            glUniform2f(glGetUniformLocation(shader.id, "heightMapOrigin"), origin.x, origin.y);
+            glUniform1f(glGetUniformLocation(shader.id, "textureScale"), static_cast<float>(textureScale));
+        }
+
+        terrainMesh->Draw(shader, camera, model);
+    }
 
     glUniform1i(glGetUniformLocation(shader.id, "blendTextures"), false);
 }
 
-float Terrain::GetHeightAt(float x, float z) const
+template <typename HeightAt>
+static float InterpolateHeight(HeightAt heightAt, unsigned int resolution, float step, float localX, float localZ)
 {
-    float halfSize = size / 2.0f;
-    if (x < -halfSize || x > halfSize || z < -halfSize || z > halfSize)
-        return 0.0f;
-
-    float step = size / (resolution - 1);
-    float localX = x + halfSize;
-    float localZ = z + halfSize;
     unsigned int gridX = static_cast<unsigned int>(localX / step);
     unsigned int gridZ = static_cast<unsigned int>(localZ / step);
 
     gridX = glm::clamp(gridX, 0u, resolution - 2);
     gridZ = glm::clamp(gridZ, 0u, resolution - 2);
 
-    float height00 = vertices[gridZ * resolution + gridX].position.y;
-    float height10 = vertices[gridZ * resolution + (gridX + 1)].position.y;
-    float height01 = vertices[(gridZ + 1) * resolution + gridX].position.y;
-    float height11 = vertices[(gridZ + 1) * resolution + (gridX + 1)].position.y;
+    float height00 = heightAt(gridX, gridZ);
+    float height10 = heightAt(gridX + 1, gridZ);
+    float height01 = heightAt(gridX, gridZ + 1);
+    float height11 = heightAt(gridX + 1, gridZ + 1);
 
     float fracX = (localX - gridX * step) / step;
     float fracZ = (localZ - gridZ * step) / step;
@@ -151,77 +310,1224 @@ float Terrain::GetHeightAt(float x, float z) const
     }
 }
 
+float Terrain::GetHeightAt(float x, float z) const
+{
+    float halfSize = size / 2.0f;
+    if (x < -halfSize || x > halfSize || z < -halfSize || z > halfSize)
+        return 0.0f;
+
+    if (chunkCount > 0)
+    {
+        float chunkSize = GetChunkSize();
+        float worldX = x + offsetX;
+        float worldZ = z + offsetZ;
+        ChunkCoord coord(static_cast<int>(std::floor(worldX / chunkSize)), static_cast<int>(std::floor(worldZ / chunkSize)));
+
+        auto chunk = chunks.find(coord);
+        if (chunk == chunks.end())
+            return 0.0f;
+
+        int lod = chunk->second.lod;
+        unsigned int chunkResolution = (chunkCells >> lod) + 1;
+        const std::vector<Vertex>& chunkVertices = chunk->second.vertices;
+        auto heightAt = [&](unsigned int gridX, unsigned int gridZ) { return chunkVertices[gridZ * chunkResolution + gridX].position.y; };
+
+        return InterpolateHeight(heightAt, chunkResolution, chunkStep * (1 << lod), worldX - coord.first * chunkSize, worldZ - coord.second * chunkSize);
+    }
+
+    if (gpuDisplacement)
+    {
+        // The height map carries a one sample border around the grid
+        unsigned int paddedResolution = resolution + 2;
+        auto heightAt = [&](unsigned int gridX, unsigned int gridZ) { return heightMapData[(gridZ + 1) * paddedResolution + gridX + 1]; };
+
+        return InterpolateHeight(heightAt, resolution, size / (resolution - 1), x + halfSize, z + halfSize);
+    }
+
+    auto heightAt = [&](unsigned int gridX, unsigned int gridZ) { return vertices[gridZ * resolution + gridX].position.y; };
+    return InterpolateHeight(heightAt, resolution, size / (resolution - 1), x + halfSize, z + halfSize);
+}
+
 void Terrain::UpdateTerrain(float offsetX, float offsetZ)
 {
-    float step = size / (resolution - 1);
+    if (pendingUpdate.valid())
+        pendingUpdate.get();
+
+    if (chunkCount > 0)
+        BuildChunks(offsetX, offsetZ);
+    else if (gpuDisplacement)
+        BuildHeightMap(heightMapData, offsetX, offsetZ);
+    else
+        BuildVertices(vertices, offsetX, offsetZ);
+
+    auto placementStart = std::chrono::high_resolution_clock::now();
+
+    for (auto& layer : objectLayers)
+    {
+        if (layer.scatter)
+        {
+            BuildScatterCells(layer, offsetX, offsetZ);
+            ApplyScatterCells(layer);
+        }
+        else
+        {
+            layer.instances = GenerateLayerInstances(layer, offsetX, offsetZ);
+            BuildLayerBvh(layer);
+        }
+    }
+
+    placementDuration = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - placementStart).count();
+
+    Terrain::offsetX = offsetX;
+    Terrain::offsetZ = offsetZ;
+
+    if (chunkCount > 0)
+        UploadChunks();
+    else
+        UploadVertices();
+}
+
+int Terrain::AddObjectLayer(int R, float noiseScale, float sizeScale, float modelYOffset)
+{
+    if (pendingUpdate.valid())
+        pendingUpdate.wait();
+
+    ObjectLayer layer;
+    layer.R = R;
+    layer.noiseScale = noiseScale;
+    layer.sizeScale = sizeScale;
+    layer.modelYOffset = modelYOffset;
+    layer.instances = GenerateObjectPositions(R, noiseScale, sizeScale, offsetX, offsetZ, modelYOffset);
+    BuildLayerBvh(layer);
+
+    objectLayers.push_back(layer);
+    return static_cast<int>(objectLayers.size()) - 1;
+}
+
+int Terrain::AddScatterLayer(const ScatterSpecies& species)
+{
+    if (pendingUpdate.valid())
+        pendingUpdate.wait();
+
+    ObjectLayer layer;
+    layer.scatter = true;
+    layer.species = species;
+    BuildScatterCells(layer, offsetX, offsetZ);
+    ApplyScatterCells(layer);
+
+    objectLayers.push_back(layer);
+    return static_cast<int>(objectLayers.size()) - 1;
+}
+
+std::vector<InstanceData> Terrain::GenerateLayerInstances(const ObjectLayer& layer, float offsetX, float offsetZ) const
+{
+    return GenerateObjectPositions(layer.R, layer.noiseScale, layer.sizeScale, offsetX, offsetZ, layer.modelYOffset);
+}
+
+void Terrain::BuildScatterCells(ObjectLayer& layer, float offsetX, float offsetZ)
+{
+    // Only reads the cell keys, the cache itself changes in ApplyScatterCells on the main thread
+    float tileSize = scatter->GetTileSize(layer.species);
     float halfSize = size / 2.0f;
-    
+    int firstX = static_cast<int>(std::floor((offsetX - halfSize) / tileSize));
+    int lastX = static_cast<int>(std::floor((offsetX + halfSize) / tileSize));
+    int firstZ = static_cast<int>(std::floor((offsetZ - halfSize) / tileSize));
+    int lastZ = static_cast<int>(std::floor((offsetZ + halfSize) / tileSize));
 
-    for (unsigned int z = 0; z < resolution; ++z)
+    // Instances sit on the chunk mesh rather than on the exact noise, so trees over coarse chunks neither float nor sink
+    bool snapToLods = chunkCount > 0 && lodDistance > 0.0f;
+
+    layer.wantedCells.clear();
+    layer.builtCells.clear();
+
+    // x before z keeps wantedCells sorted for the lookups in ApplyScatterCells
+    for (int x = firstX; x <= lastX; ++x)
     {
-        for (unsigned int x = 0; x < resolution; ++x)
+        for (int z = firstZ; z <= lastZ; ++z)
         {
-            unsigned int index = z * resolution + x;
-            float worldX = -halfSize + x * step + offsetX;
-            float worldZ = -halfSize + z * step + offsetZ;
-            vertices[index].position.y = noise.GetNoise(worldX, worldZ) * heightScale;
-            vertices[index].height = vertices[index].position.y;
-            vertices[index].textureUV = glm::vec2(worldX / textureScale, worldZ / textureScale);
+            ChunkCoord coord(x, z);
+            layer.wantedCells.push_back(coord);
+            unsigned long long lodKey = snapToLods ? GetCellLodKey(coord, tileSize, offsetX, offsetZ) : 0;
+
+            auto cell = layer.cells.find(coord);
+            if (cell == layer.cells.end() || cell->second.lodKey != lodKey)
+            {
+                layer.builtCells.emplace_back();
+                layer.builtCells.back().coord = coord;
+                layer.builtCells.back().lodKey = lodKey;
+            }
         }
     }
 
-    CalculateNormals(vertices, indices);
+    threadPool->ParallelFor(0, static_cast<unsigned int>(layer.builtCells.size()), [&](unsigned int first, unsigned int last)
+    {
+        for (unsigned int i = first; i < last; ++i)
+        {
+            ScatterCellBuild& build = layer.builtCells[i];
+            scatter->GenerateTile(layer.species, build.coord.first, build.coord.second, build.instances);
 
-    terrainMesh->UpdateVertices(vertices, indices);
+            if (!snapToLods)
+                continue;
+
+            for (InstanceData& instance : build.instances)
+            {
+                instance.position.y = SampleSurfaceHeight(instance.position.x, instance.position.z, offsetX, offsetZ) + layer.species.modelYOffset;
+            }
+        }
+    });
 }
 
-std::vector<glm::mat4> Terrain::GenerateObjectPositions(int R, float noiseScale, float sizeScale, float offsetX, float offsetZ, float modelYOffset) const
-{   
-    std::vector<glm::mat4> instances;
-    std::vector<std::vector<double>> blueNoise(resolution, std::vector<double>(resolution, 0.0));
+void Terrain::ApplyScatterCells(ObjectLayer& layer)
+{
+    // Cells that left the window give their slot back, cleared so the shaders skip it until it is reused
+    for (auto cell = layer.cells.begin(); cell != layer.cells.end();)
+    {
+        if (std::binary_search(layer.wantedCells.begin(), layer.wantedCells.end(), cell->first))
+        {
+            ++cell;
+            continue;
+        }
+
+        auto slotBegin = layer.instances.begin() + cell->second.slot * layer.slotCapacity;
+        std::fill(slotBegin, slotBegin + cell->second.count, InstanceData());
+        layer.bvh.SetLeaf(cell->second.slot, layer.instances, 0, 0);
+        layer.freeSlots.push_back(cell->second.slot);
+        layer.dirtySlots.insert(cell->second.slot);
+        cell = layer.cells.erase(cell);
+    }
 
-    for (unsigned int y = 0; y < resolution; y++) {
-        for (unsigned int x = 0; x < resolution; x++) {
-            float worldX = (- size / 2.0f + x * (size / (resolution - 1)) + offsetX);
-            float worldZ = (- size / 2.0f + y * (size / (resolution - 1)) + offsetZ);
+    size_t largestCell = 0;
+    for (const ScatterCellBuild& build : layer.builtCells)
+    {
+        largestCell = std::max(largestCell, build.instances.size());
+    }
+
+    if (largestCell > layer.slotCapacity || layer.slotCapacity == 0)
+    {
+        // Grow every slot with some headroom and repack the cached cells, this rewrites the whole array
+        unsigned int slotCapacity = (static_cast<unsigned int>(std::max<size_t>(largestCell, 1)) + 31) & ~31u;
+        std::vector<InstanceData> instances(layer.cells.size() * slotCapacity);
+        unsigned int slot = 0;
 
-            blueNoise[y][x] = noise.GetNoise(worldX * noiseScale / size, worldZ * noiseScale / size);
+        for (auto& cell : layer.cells)
+        {
+            auto source = layer.instances.begin() + cell.second.slot * layer.slotCapacity;
+            std::copy(source, source + cell.second.count, instances.begin() + slot * slotCapacity);
+            cell.second.slot = slot++;
+        }
+
+        layer.instances.swap(instances);
+        layer.bvh.Clear();
+        for (const auto& cell : layer.cells)
+        {
+            layer.bvh.SetLeaf(cell.second.slot, layer.instances, cell.second.slot * slotCapacity, cell.second.count);
         }
+
+        layer.slotCapacity = slotCapacity;
+        layer.freeSlots.clear();
+        layer.dirtySlots.clear();
+        layer.instancesResized = true;
     }
 
-    for (unsigned int yc = 0; yc < resolution; yc++) {
-        for (unsigned int xc = 0; xc < resolution; xc++) {
-            double currentValue = blueNoise[yc][xc];
-            bool isLocalMax = true;
+    for (const ScatterCellBuild& build : layer.builtCells)
+    {
+        ScatterCell cell;
+        cell.count = static_cast<unsigned int>(build.instances.size());
+        cell.lodKey = build.lodKey;
 
-            for (int dy = -R; dy <= R && isLocalMax; dy++) {
-                for (int dx = -R; dx <= R && isLocalMax; dx++) {
-                    if (dx * dx + dy * dy > R * (R + 1))
-                        continue;
+        auto existing = layer.cells.find(build.coord);
+        if (existing != layer.cells.end())
+        {
+            // A cell rebuilt for new chunk LODs keeps its slot, the old entries are cleared first
+            cell.slot = existing->second.slot;
+            auto slotBegin = layer.instances.begin() + cell.slot * layer.slotCapacity;
+            std::fill(slotBegin, slotBegin + existing->second.count, InstanceData());
+        }
+        else if (!layer.freeSlots.empty())
+        {
+            cell.slot = layer.freeSlots.back();
+            layer.freeSlots.pop_back();
+        }
+        else
+        {
+            cell.slot = static_cast<unsigned int>(layer.instances.size() / layer.slotCapacity);
+            layer.instances.resize(layer.instances.size() + layer.slotCapacity);
+            layer.instancesResized = true;
+        }
 
-                    int xn = static_cast<int>(xc) + dx;
-                    int yn = static_cast<int>(yc) + dy;
+        std::copy(build.instances.begin(), build.instances.end(), layer.instances.begin() + cell.slot * layer.slotCapacity);
+        layer.bvh.SetLeaf(cell.slot, layer.instances, cell.slot * layer.slotCapacity, cell.count);
+        layer.dirtySlots.insert(cell.slot);
+        layer.cells[build.coord] = cell;
+    }
 
-                    if (xn >= 0 && xn < static_cast<int>(resolution) && yn >= 0 && yn < static_cast<int>(resolution)) {
-                        if (blueNoise[yn][xn] > currentValue) {
-                            isLocalMax = false;
-                        }
-                    }
-                }
-            }
+    layer.builtCells.clear();
 
-            if (isLocalMax) {
-                const Vertex& vertex = vertices[yc * resolution + xc];
-                glm::vec3 position = glm::vec3(vertex.position.x, vertex.position.y + modelYOffset, vertex.position.z);
+    // Only the leaves of changed cells were refit, the levels above are rebuilt from the leaf boxes
+    layer.bvh.Build();
+}
 
-                glm::mat4 modelMatrix = glm::mat4(1.0f);
-                modelMatrix = glm::translate(modelMatrix, position);
-                modelMatrix = glm::scale(modelMatrix, glm::vec3(sizeScale));
+void Terrain::BuildLayerBvh(ObjectLayer& layer)
+{
+    // Grid layers are regenerated as a whole, instances come in row order so runs of them stay compact
+    const unsigned int bvhLeafSize = 64;
+    unsigned int instanceCount = static_cast<unsigned int>(layer.instances.size());
 
-                instances.push_back(modelMatrix);
-            }
+    layer.bvh.Clear();
+    for (unsigned int first = 0; first < instanceCount; first += bvhLeafSize)
+    {
+        layer.bvh.SetLeaf(first / bvhLeafSize, layer.instances, first, std::min(bvhLeafSize, instanceCount - first));
+    }
+    layer.bvh.Build();
+}
+
+bool Terrain::FindNearestObject(int layer, glm::vec3 position, float maxDistance, glm::vec3& objectPosition) const
+{
+    const ObjectLayer& objectLayer = objectLayers[layer];
+    glm::vec3 origin = GetObjectOrigin(layer);
+
+    int nearest = objectLayer.bvh.FindNearest(objectLayer.instances, position + origin, maxDistance);
+    if (nearest < 0)
+        return false;
+
+    objectPosition = objectLayer.instances[nearest].position - origin;
+    return true;
+}
+
+void Terrain::UploadObjectInstances(int layer, Model& model)
+{
+    ObjectLayer& objectLayer = objectLayers[layer];
+
+    if (!objectLayer.scatter || objectLayer.instancesResized)
+    {
+        model.UpdateInstances(static_cast<unsigned int>(objectLayer.instances.size()), objectLayer.instances);
+        objectLayer.instancesResized = false;
+        objectLayer.dirtySlots.clear();
+        return;
+    }
+
+    // Neighbouring dirty slots are written with one call
+    std::set<unsigned int>& dirty = objectLayer.dirtySlots;
+
+    for (auto slot = dirty.begin(); slot != dirty.end();)
+    {
+        unsigned int firstSlot = *slot;
+        unsigned int lastSlot = firstSlot;
+        while (++slot != dirty.end() && *slot == lastSlot + 1)
+            lastSlot = *slot;
+
+        unsigned int first = firstSlot * objectLayer.slotCapacity;
+        unsigned int count = (lastSlot - firstSlot + 1) * objectLayer.slotCapacity;
+        model.UpdateInstanceRange(first, count, &objectLayer.instances[first]);
+    }
+
+    dirty.clear();
+}
+
+void Terrain::BeginUpdate(float offsetX, float offsetZ)
+{
+    if (pendingUpdate.valid())
+        pendingUpdate.get();
+
+    pendingOffsetX = offsetX;
+    pendingOffsetZ = offsetZ;
+
+    pendingUpdate = std::async(std::launch::async, [this, offsetX, offsetZ]
+    {
+        if (chunkCount > 0)
+            BuildChunks(offsetX, offsetZ);
+        else if (gpuDisplacement)
+            BuildHeightMap(backHeightMapData, offsetX, offsetZ);
+        else
+            BuildVertices(backVertices, offsetX, offsetZ);
+
+        auto placementStart = std::chrono::high_resolution_clock::now();
+
+        for (auto& layer : objectLayers)
+        {
+            if (layer.scatter)
+                BuildScatterCells(layer, offsetX, offsetZ);
+            else
+                layer.backInstances = GenerateLayerInstances(layer, offsetX, offsetZ);
+        }
+
+        placementDuration = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - placementStart).count();
+    });
+}
+
+bool Terrain::FinishUpdate()
+{
+    if (!pendingUpdate.valid() || pendingUpdate.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+
+    pendingUpdate.get();
+
+    if (gpuDisplacement)
+        heightMapData.swap(backHeightMapData);
+    else if (chunkCount == 0)
+        vertices.swap(backVertices);
+
+    for (auto& layer : objectLayers)
+    {
+        if (layer.scatter)
+            ApplyScatterCells(layer);
+        else
+        {
+            layer.instances.swap(layer.backInstances);
+            BuildLayerBvh(layer);
         }
     }
 
-    return instances;
-}
\ No newline at end of file
+    offsetX = pendingOffsetX;
+    offsetZ = pendingOffsetZ;
+
+    if (chunkCount > 0)
+        UploadChunks();
+    else
+        UploadVertices();
+
+    return true;
+}
+
+static int WrapIndex(int value, int count)
+{
+    int wrapped = value % count;
+    return wrapped < 0 ? wrapped + count : wrapped;
+}
+
+glm::vec2 Terrain::GetHeightMapOrigin(float offsetX, float offsetZ) const
+{
+    // World position of the first padded sample, the window starts one cell before the rounded offset
+    float step = size / (resolution - 1);
+    float halfSize = size / 2.0f;
+    int originX = static_cast<int>(std::lround(offsetX / step)) - 1;
+    int originZ = static_cast<int>(std::lround(offsetZ / step)) - 1;
+
+    return glm::vec2(-halfSize + originX * step, -halfSize + originZ * step);
+}
+
+void Terrain::BuildHeights(float offsetX, float offsetZ)
+{
+    float step = size / (resolution - 1);
+    float halfSize = size / 2.0f;
+    int paddedResolution = static_cast<int>(resolution) + 2;
+
+    // Heights live on a fixed world lattice and are addressed toroidally, lattice cell c is stored in slot c mod paddedResolution.
+    // The window keeps a one vertex border so normals see past its edge. Offsets are rounded to whole cells.
+    int originX = static_cast<int>(std::lround(offsetX / step)) - 1;
+    int originZ = static_cast<int>(std::lround(offsetZ / step)) - 1;
+
+    if (heightRing.empty())
+        heightRing.resize(paddedResolution * paddedResolution);
+
+    // Cells of the new window that are already in the ring, everything outside this rectangle gets sampled
+    int keptBeginX = 0, keptEndX = 0, keptBeginZ = 0, keptEndZ = 0;
+    if (ringValid && std::abs(originX - ringOriginX) < paddedResolution && std::abs(originZ - ringOriginZ) < paddedResolution)
+    {
+        keptBeginX = std::max(originX, ringOriginX);
+        keptEndX = std::min(originX, ringOriginX) + paddedResolution;
+        keptBeginZ = std::max(originZ, ringOriginZ);
+        keptEndZ = std::min(originZ, ringOriginZ) + paddedResolution;
+    }
+
+    std::vector<float> rowX(paddedResolution);
+    std::vector<int> columnSlot(paddedResolution);
+    for (int i = 0; i < paddedResolution; ++i)
+    {
+        rowX[i] = -halfSize + (originX + i) * step;
+        columnSlot[i] = WrapIndex(originX + i, paddedResolution);
+    }
+
+    threadPool->ParallelFor(0, paddedResolution, [&](unsigned int firstRow, unsigned int lastRow)
+    {
+        std::vector<float> heights(paddedResolution);
+
+        for (unsigned int row = firstRow; row < lastRow; ++row)
+        {
+            int cellZ = originZ + static_cast<int>(row);
+            float worldZ = -halfSize + cellZ * step;
+            float* ringRow = &heightRing[WrapIndex(cellZ, paddedResolution) * paddedResolution];
+
+            // Old rows only need the columns that scrolled in on either side
+            int segments[2][2] = { { 0, paddedResolution }, { 0, 0 } };
+            if (cellZ >= keptBeginZ && cellZ < keptEndZ)
+            {
+                segments[0][1] = keptBeginX - originX;
+                segments[1][0] = keptEndX - originX;
+                segments[1][1] = paddedResolution;
+            }
+
+            for (auto& segment : segments)
+            {
+                if (segment[1] <= segment[0])
+                    continue;
+
+                noise.GetNoiseRow(&rowX[segment[0]], worldZ, segment[1] - segment[0], &heights[segment[0]], heightScale);
+                for (int column = segment[0]; column < segment[1]; ++column)
+                {
+                    ringRow[columnSlot[column]] = heights[column];
+                }
+            }
+        }
+    });
+
+    ringOriginX = originX;
+    ringOriginZ = originZ;
+    ringValid = true;
+    sampledHeights = paddedResolution * paddedResolution - (keptEndX - keptBeginX) * (keptEndZ - keptBeginZ);
+}
+
+void Terrain::BuildVertices(std::vector<Vertex>& target, float offsetX, float offsetZ)
+{
+    float step = size / (resolution - 1);
+    float halfSize = size / 2.0f;
+    int paddedResolution = static_cast<int>(resolution) + 2;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    BuildHeights(offsetX, offsetZ);
+
+    std::vector<float> worldX(paddedResolution);
+    std::vector<int> columnSlot(paddedResolution);
+    std::vector<int> rowSlot(paddedResolution);
+    for (int i = 0; i < paddedResolution; ++i)
+    {
+        worldX[i] = -halfSize + (ringOriginX + i) * step;
+        columnSlot[i] = WrapIndex(ringOriginX + i, paddedResolution);
+        rowSlot[i] = WrapIndex(ringOriginZ + i, paddedResolution) * paddedResolution;
+    }
+
+    // Every row only writes its own vertices, so the result does not depend on how rows are split
+    threadPool->ParallelFor(0, resolution, [&](unsigned int firstRow, unsigned int lastRow)
+    {
+        for (unsigned int z = firstRow; z < lastRow; ++z)
+        {
+            const float* below = &heightRing[rowSlot[z]];
+            const float* center = &heightRing[rowSlot[z + 1]];
+            const float* above = &heightRing[rowSlot[z + 2]];
+            float worldZ = -halfSize + (ringOriginZ + static_cast<int>(z) + 1) * step;
+
+            for (unsigned int x = 0; x < resolution; ++x)
+            {
+                unsigned int index = z * resolution + x;
+                float height = center[columnSlot[x + 1]];
+                target[index].position.y = height;
+                target[index].height = height;
+                target[index].normal = HeightfieldNormal(center[columnSlot[x]], center[columnSlot[x + 2]], below[columnSlot[x + 1]], above[columnSlot[x + 1]], step);
+                target[index].textureUV = glm::vec2(worldX[x + 1] / textureScale, worldZ / textureScale);
+            }
+        }
+    });
+
+    buildDuration = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void Terrain::BuildHeightMap(std::vector<float>& target, float offsetX, float offsetZ)
+{
+    int paddedResolution = static_cast<int>(resolution) + 2;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    BuildHeights(offsetX, offsetZ);
+
+    // The texture is uploaded in window order, which unwraps the ring
+    target.resize(paddedResolution * paddedResolution);
+
+    int firstColumn = WrapIndex(ringOriginX, paddedResolution);
+    int firstRow = WrapIndex(ringOriginZ, paddedResolution);
+    for (int z = 0; z < paddedResolution; ++z)
+    {
+        const float* ringRow = &heightRing[((firstRow + z) % paddedResolution) * paddedResolution];
+        float* targetRow = &target[z * paddedResolution];
+
+        std::copy(ringRow + firstColumn, ringRow + paddedResolution, targetRow);
+        std::copy(ringRow, ringRow + firstColumn, targetRow + (paddedResolution - firstColumn));
+    }
+
+    buildDuration = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void Terrain::UploadVertices()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    if (heightMap)
+        heightMap->Upload(heightMapData.data(), resolution + 2, resolution + 2);
+    else
+        terrainMesh->UpdateVertices(vertices);
+
+    auto uploadTime = std::chrono::high_resolution_clock::now();
+
+    if (timingReport)
+    {
+        std::chrono::duration<double, std::milli> uploadDuration = uploadTime - startTime;
+
+        std::cout << "Terrain update (" << threadPool->GetThreadCount() << " threads, " << FractalNoise::GetInstructionSet() << "): "
+            << sampledHeights << " heights sampled, "
+            << "build " << buildDuration << " ms, "
+            << "placement " << placementDuration << " ms, "
+            << "upload " << uploadDuration.count() << " ms" << std::endl;
+    }
+}
+
+void Terrain::BenchmarkNormals(unsigned int iterations)
+{
+    if (chunkCount > 0 || gpuDisplacement || iterations == 0)
+        return;
+
+    float step = size / (resolution - 1);
+    float halfSize = size / 2.0f;
+    unsigned int paddedResolution = resolution + 2;
+
+    std::vector<float> rowX(paddedResolution);
+    for (unsigned int x = 0; x < paddedResolution; ++x)
+    {
+        rowX[x] = -halfSize + (static_cast<int>(x) - 1) * step + offsetX;
+    }
+
+    std::vector<float> heights(paddedResolution * paddedResolution);
+    for (unsigned int z = 0; z < paddedResolution; ++z)
+    {
+        float worldZ = -halfSize + (static_cast<int>(z) - 1) * step + offsetZ;
+        noise.GetNoiseRow(rowX.data(), worldZ, paddedResolution, &heights[z * paddedResolution], heightScale);
+    }
+
+    std::vector<GLuint> gridIndexData;
+    GenerateIndices(resolution, gridIndexData);
+
+    std::vector<Vertex> triangleNormals = vertices;
+    std::vector<Vertex> heightNormals = vertices;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    for (unsigned int i = 0; i < iterations; ++i)
+    {
+        CalculateNormals(triangleNormals, gridIndexData);
+    }
+
+    auto triangleTime = std::chrono::high_resolution_clock::now();
+
+    for (unsigned int i = 0; i < iterations; ++i)
+    {
+        for (unsigned int z = 0; z < resolution; ++z)
+        {
+            for (unsigned int x = 0; x < resolution; ++x)
+            {
+                unsigned int padded = (z + 1) * paddedResolution + x + 1;
+                heightNormals[z * resolution + x].normal = HeightfieldNormal(heights[padded - 1], heights[padded + 1], heights[padded - paddedResolution], heights[padded + paddedResolution], step);
+            }
+        }
+    }
+
+    auto heightTime = std::chrono::high_resolution_clock::now();
+
+    // The border normals differ by design, the central differences see past the window edge
+    float maxAngle = 0.0f;
+    for (unsigned int z = 1; z < resolution - 1; ++z)
+    {
+        for (unsigned int x = 1; x < resolution - 1; ++x)
+        {
+            unsigned int index = z * resolution + x;
+            float cosine = glm::clamp(glm::dot(triangleNormals[index].normal, heightNormals[index].normal), -1.0f, 1.0f);
+            maxAngle = std::max(maxAngle, glm::degrees(std::acos(cosine)));
+        }
+    }
+
+    std::chrono::duration<double, std::milli> triangleDuration = triangleTime - startTime;
+    std::chrono::duration<double, std::milli> heightDuration = heightTime - triangleTime;
+
+    std::cout << "Terrain normals (" << resolution << "x" << resolution << ", " << iterations << " runs): "
+        << "triangle accumulation " << triangleDuration.count() / iterations << " ms, "
+        << "central differences " << heightDuration.count() / iterations << " ms, "
+        << "max interior difference " << maxAngle << " degrees" << std::endl;
+}
+
+std::vector<ChunkCoord> Terrain::GetVisibleChunks(float offsetX, float offsetZ) const
+{
+    float chunkSize = GetChunkSize();
+    float halfSize = size / 2.0f;
+
+    int minX = static_cast<int>(std::floor((offsetX - halfSize) / chunkSize));
+    int maxX = static_cast<int>(std::floor((offsetX + halfSize) / chunkSize));
+    int minZ = static_cast<int>(std::floor((offsetZ - halfSize) / chunkSize));
+    int maxZ = static_cast<int>(std::floor((offsetZ + halfSize) / chunkSize));
+
+    std::vector<ChunkCoord> visible;
+    for (int z = minZ; z <= maxZ; ++z)
+    {
+        for (int x = minX; x <= maxX; ++x)
+        {
+            visible.push_back(ChunkCoord(x, z));
+        }
+    }
+
+    return visible;
+}
+
+size_t Terrain::GetTriangleCount() const
+{
+    if (chunkCount == 0)
+        return static_cast<size_t>(resolution - 1) * (resolution - 1) * 2;
+
+    size_t triangles = 0;
+    for (const auto& chunk : chunks)
+    {
+        size_t cells = chunkCells >> chunk.second.lod;
+        triangles += cells * cells * 2;
+    }
+
+    return triangles;
+}
+
+int Terrain::GetChunkLod(ChunkCoord coord, float offsetX, float offsetZ) const
+{
+    if (lodDistance <= 0.0f)
+        return 0;
+
+    float chunkSize = GetChunkSize();
+    float centerX = (coord.first + 0.5f) * chunkSize - offsetX;
+    float centerZ = (coord.second + 0.5f) * chunkSize - offsetZ;
+    float distance = std::sqrt(centerX * centerX + centerZ * centerZ);
+
+    int lod = 0;
+    float range = lodDistance;
+    while (distance > range && lod < maxLod)
+    {
+        lod++;
+        range *= 2.0f;
+    }
+
+    return lod;
+}
+
+unsigned long long Terrain::GetCellLodKey(ChunkCoord cell, float tileSize, float offsetX, float offsetZ) const
+{
+    float chunkSize = GetChunkSize();
+    int firstX = static_cast<int>(std::floor(cell.first * tileSize / chunkSize));
+    int lastX = static_cast<int>(std::floor((cell.first + 1) * tileSize / chunkSize));
+    int firstZ = static_cast<int>(std::floor(cell.second * tileSize / chunkSize));
+    int lastZ = static_cast<int>(std::floor((cell.second + 1) * tileSize / chunkSize));
+
+    // FNV-1a over the LOD of every chunk the cell overlaps and their neighbours, which decide how chunk edges are stitched
+    unsigned long long key = 14695981039346656037ull;
+    for (int x = firstX - 1; x <= lastX + 1; ++x)
+    {
+        for (int z = firstZ - 1; z <= lastZ + 1; ++z)
+        {
+            key ^= static_cast<unsigned long long>(GetChunkLod(ChunkCoord(x, z), offsetX, offsetZ) + 1);
+            key *= 1099511628211ull;
+        }
+    }
+
+    return key;
+}
+
+float Terrain::SampleSurfaceHeight(float worldX, float worldZ, float offsetX, float offsetZ) const
+{
+    static const int edgeDirections[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+
+    float chunkSize = GetChunkSize();
+    ChunkCoord coord(static_cast<int>(std::floor(worldX / chunkSize)), static_cast<int>(std::floor(worldZ / chunkSize)));
+    int lod = GetChunkLod(coord, offsetX, offsetZ);
+    int edgeLods[4];
+    for (int edge = 0; edge < 4; ++edge)
+    {
+        edgeLods[edge] = std::max(lod, GetChunkLod(ChunkCoord(coord.first + edgeDirections[edge][0], coord.second + edgeDirections[edge][1]), offsetX, offsetZ));
+    }
+
+    int stride = 1 << lod;
+    float step = chunkStep * stride;
+    int baseX = coord.first * static_cast<int>(chunkCells);
+    int baseZ = coord.second * static_cast<int>(chunkCells);
+
+    // Same lattice samples as BuildChunkVertices, including the edges it flattens onto a coarser neighbour
+    auto latticeHeight = [&](int x, int z) { return SampleHeight((baseX + x) * chunkStep, (baseZ + z) * chunkStep); };
+    auto heightAt = [&](unsigned int gridX, unsigned int gridZ)
+    {
+        int x = static_cast<int>(gridX) * stride;
+        int z = static_cast<int>(gridZ) * stride;
+        int last = static_cast<int>(chunkCells);
+        int edge = z == 0 ? 0 : x == last ? 1 : z == last ? 2 : x == 0 ? 3 : -1;
+        if (edge < 0 || edgeLods[edge] == lod)
+            return latticeHeight(x, z);
+
+        int coarse = 1 << edgeLods[edge];
+        int along = edge == 0 || edge == 2 ? x : z;
+        int start = along / coarse * coarse;
+        if (start == along)
+            return latticeHeight(x, z);
+
+        float t = static_cast<float>(along - start) / coarse;
+        float startHeight = edge == 0 || edge == 2 ? latticeHeight(start, z) : latticeHeight(x, start);
+        float endHeight = edge == 0 || edge == 2 ? latticeHeight(start + coarse, z) : latticeHeight(x, start + coarse);
+        return startHeight + (endHeight - startHeight) * t;
+    };
+
+    unsigned int chunkResolution = (chunkCells >> lod) + 1;
+    return InterpolateHeight(heightAt, chunkResolution, step, worldX - baseX * chunkStep, worldZ - baseZ * chunkStep);
+}
+
+void Terrain::BuildChunks(float offsetX, float offsetZ)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    static const int edgeDirections[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+
+    builtChunks.clear();
+    for (const ChunkCoord& coord : GetVisibleChunks(offsetX, offsetZ))
+    {
+        ChunkBuild build;
+        build.coord = coord;
+        build.lod = GetChunkLod(coord, offsetX, offsetZ);
+
+        // An edge shared with a coarser neighbour is flattened onto the neighbour's vertices so no cracks open between them
+        for (int edge = 0; edge < 4; ++edge)
+        {
+            ChunkCoord neighbour(coord.first + edgeDirections[edge][0], coord.second + edgeDirections[edge][1]);
+            build.edgeLods[edge] = std::max(build.lod, GetChunkLod(neighbour, offsetX, offsetZ));
+        }
+
+        auto chunk = chunks.find(coord);
+        if (chunk != chunks.end() && chunk->second.lod == build.lod && std::equal(build.edgeLods, build.edgeLods + 4, chunk->second.edgeLods))
+            continue;
+
+        builtChunks.push_back(std::move(build));
+    }
+
+    threadPool->ParallelFor(0, static_cast<unsigned int>(builtChunks.size()), [&](unsigned int first, unsigned int last)
+    {
+        for (unsigned int i = first; i < last; ++i)
+        {
+            BuildChunkVertices(builtChunks[i]);
+        }
+    });
+
+    buildDuration = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void Terrain::BuildChunkVertices(ChunkBuild& build) const
+{
+    int stride = 1 << build.lod;
+    unsigned int chunkResolution = (chunkCells >> build.lod) + 1;
+    float step = chunkStep * stride;
+
+    // Heights are sampled on the global vertex lattice, so neighbouring chunks produce identical border vertices
+    int baseX = build.coord.first * static_cast<int>(chunkCells);
+    int baseZ = build.coord.second * static_cast<int>(chunkCells);
+
+    // One extra ring of heights lets border normals see the neighbouring chunk
+    unsigned int paddedResolution = chunkResolution + 2;
+    std::vector<float> heights(paddedResolution * paddedResolution);
+    std::vector<float> rowX(paddedResolution);
+
+    for (unsigned int x = 0; x < paddedResolution; ++x)
+    {
+        rowX[x] = (baseX + (static_cast<int>(x) - 1) * stride) * chunkStep;
+    }
+
+    for (unsigned int z = 0; z < paddedResolution; ++z)
+    {
+        float worldZ = (baseZ + (static_cast<int>(z) - 1) * stride) * chunkStep;
+        noise.GetNoiseRow(rowX.data(), worldZ, paddedResolution, &heights[z * paddedResolution], heightScale);
+    }
+
+    std::vector<Vertex>& target = build.vertices;
+    target.resize(chunkResolution * chunkResolution);
+
+    for (unsigned int z = 0; z < chunkResolution; ++z)
+    {
+        for (unsigned int x = 0; x < chunkResolution; ++x)
+        {
+            unsigned int padded = (z + 1) * paddedResolution + (x + 1);
+            float height = heights[padded];
+            float worldX = (baseX + static_cast<int>(x) * stride) * chunkStep;
+            float worldZ = (baseZ + static_cast<int>(z) * stride) * chunkStep;
+
+            Vertex& vertex = target[z * chunkResolution + x];
+            vertex.position = glm::vec3(x * step, height, z * step);
+            vertex.normal = HeightfieldNormal(heights[padded - 1], heights[padded + 1], heights[padded - paddedResolution], heights[padded + paddedResolution], step);
+            vertex.color = glm::vec3(1.0f, 1.0f, 1.0f);
+            vertex.textureUV = glm::vec2(worldX / textureScale, worldZ / textureScale);
+            vertex.height = height;
+        }
+    }
+
+    // Vertex i along an edge, depth rows in from it
+    unsigned int last = chunkResolution - 1;
+    auto edgeIndex = [&](int edge, unsigned int i, unsigned int depth) -> unsigned int
+    {
+        switch (edge)
+        {
+        case 0: return depth * chunkResolution + i;
+        case 1: return i * chunkResolution + last - depth;
+        case 2: return (last - depth) * chunkResolution + i;
+        default: return i * chunkResolution + depth;
+        }
+    };
+    auto paddedIndex = [&](unsigned int index) { return (index / chunkResolution + 1) * paddedResolution + index % chunkResolution + 1; };
+
+    for (int edge = 0; edge < 4; ++edge)
+    {
+        unsigned int ratio = 1u << (build.edgeLods[edge] - build.lod);
+        if (ratio == 1)
+            continue;
+
+        for (unsigned int i = 0; i < last; i += ratio)
+        {
+            float startHeight = target[edgeIndex(edge, i, 0)].position.y;
+            float endHeight = target[edgeIndex(edge, i + ratio, 0)].position.y;
+
+            for (unsigned int j = 1; j < ratio; ++j)
+            {
+                unsigned int index = edgeIndex(edge, i + j, 0);
+                Vertex& vertex = target[index];
+                vertex.position.y = startHeight + (endHeight - startHeight) * (static_cast<float>(j) / ratio);
+                vertex.height = vertex.position.y;
+                heights[paddedIndex(index)] = vertex.position.y;
+            }
+        }
+    }
+
+    // Flattened edges take the normals the coarser neighbour computes along them, interpolated like its edge triangles,
+    // and the row inside them is recomputed from the flattened heights so no lighting seam is left at the border
+    for (int edge = 0; edge < 4; ++edge)
+    {
+        unsigned int ratio = 1u << (build.edgeLods[edge] - build.lod);
+        if (ratio == 1)
+            continue;
+
+        float coarseStep = step * ratio;
+        auto coarseNormal = [&](unsigned int i)
+        {
+            const glm::vec3& position = target[edgeIndex(edge, i, 0)].position;
+            float worldX = (baseX + static_cast<int>(std::lround(position.x / step)) * stride) * chunkStep;
+            float worldZ = (baseZ + static_cast<int>(std::lround(position.z / step)) * stride) * chunkStep;
+            return HeightfieldNormal(SampleHeight(worldX - coarseStep, worldZ), SampleHeight(worldX + coarseStep, worldZ),
+                SampleHeight(worldX, worldZ - coarseStep), SampleHeight(worldX, worldZ + coarseStep), coarseStep);
+        };
+
+        for (unsigned int i = 0; i < last; i += ratio)
+        {
+            glm::vec3 startNormal = coarseNormal(i);
+            glm::vec3 endNormal = coarseNormal(i + ratio);
+
+            // Corners keep their own normal, they are shared with the chunks across the other edges too
+            for (unsigned int j = 0; j <= ratio; ++j)
+            {
+                if (i + j == 0 || i + j == last)
+                    continue;
+
+                glm::vec3 normal = startNormal + (endNormal - startNormal) * (static_cast<float>(j) / ratio);
+                target[edgeIndex(edge, i + j, 0)].normal = glm::normalize(normal);
+            }
+        }
+
+        if (last < 2)
+            continue;
+
+        for (unsigned int i = 1; i < last; ++i)
+        {
+            unsigned int index = edgeIndex(edge, i, 1);
+            unsigned int padded = paddedIndex(index);
+            target[index].normal = HeightfieldNormal(heights[padded - 1], heights[padded + 1], heights[padded - paddedResolution], heights[padded + paddedResolution], step);
+        }
+    }
+}
+
+void Terrain::UploadChunks()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<ChunkCoord> visible = GetVisibleChunks(offsetX, offsetZ);
+    size_t evicted = 0;
+
+    for (auto chunk = chunks.begin(); chunk != chunks.end();)
+    {
+        if (std::find(visible.begin(), visible.end(), chunk->first) == visible.end())
+        {
+            freeChunkMeshes.push_back(chunk->second.mesh);
+            chunk = chunks.erase(chunk);
+            evicted++;
+        }
+        else
+        {
+            ++chunk;
+        }
+    }
+
+    for (auto& built : builtChunks)
+    {
+        TerrainChunk& chunk = chunks[built.coord];
+        chunk.lod = built.lod;
+        std::copy(built.edgeLods, built.edgeLods + 4, chunk.edgeLods);
+        chunk.vertices.swap(built.vertices);
+
+        const GridIndices& grid = GetGridIndices((chunkCells >> chunk.lod) + 1);
+
+        if (chunk.mesh == nullptr && !freeChunkMeshes.empty())
+        {
+            chunk.mesh = freeChunkMeshes.back();
+            freeChunkMeshes.pop_back();
+        }
+
+        if (chunk.mesh != nullptr)
+        {
+            chunk.mesh->SetIndexBuffer(*grid.ebo, grid.count, grid.type);
+            chunk.mesh->UpdateVertices(chunk.vertices);
+        }
+        else
+        {
+            chunk.mesh = new Mesh(chunk.vertices, *grid.ebo, grid.count, grid.type, textures);
+        }
+    }
+
+    auto uploadTime = std::chrono::high_resolution_clock::now();
+
+    if (timingReport)
+    {
+        std::chrono::duration<double, std::milli> uploadDuration = uploadTime - startTime;
+
+        std::cout << "Terrain update (" << threadPool->GetThreadCount() << " threads, " << FractalNoise::GetInstructionSet() << "): "
+            << builtChunks.size() << " chunks built, " << evicted << " evicted, "
+            << GetTriangleCount() << " triangles, "
+            << "build " << buildDuration << " ms, "
+            << "placement " << placementDuration << " ms, "
+            << "upload " << uploadDuration.count() << " ms" << std::endl;
+    }
+
+    builtChunks.clear();
+}
+
+// Maximum over [x - radius, x + radius] for every x of one row, clipped to the row.
+// van Herk / Gil-Werman: prefix and suffix maxima inside blocks of the window size give each window in two lookups.
+static void RowWindowMax(const float* row, int count, int radius, float* out, std::vector<float>& padded, std::vector<float>& prefix, std::vector<float>& suffix)
+{
+    int window = 2 * radius + 1;
+    int paddedCount = (count + 2 * radius + window - 1) / window * window;
+
+    // Padded index i holds row[i - radius], outside the row counts as -infinity
+    padded.assign(paddedCount, -std::numeric_limits<float>::infinity());
+    std::copy(row, row + count, padded.begin() + radius);
+    prefix.resize(paddedCount);
+    suffix.resize(paddedCount);
+
+    for (int block = 0; block < paddedCount; block += window)
+    {
+        prefix[block] = padded[block];
+        for (int i = block + 1; i < block + window; ++i)
+            prefix[i] = std::max(prefix[i - 1], padded[i]);
+
+        suffix[block + window - 1] = padded[block + window - 1];
+        for (int i = block + window - 2; i >= block; --i)
+            suffix[i] = std::max(suffix[i + 1], padded[i]);
+    }
+
+    for (int x = 0; x < count; ++x)
+    {
+        out[x] = std::max(suffix[x], prefix[x + window - 1]);
+    }
+}
+
+// Cells in rows [firstRow, lastRow) of a gridResolution² field that no cell within the disk dx² + dy² <= R(R + 1) exceeds, in row-major order.
+// The disk is split into rows and every distinct row half-width is one max filter, so the cost is O(res² R) instead of O(res² R²).
+// The widest row (dy = 0) goes first, later widths only check the cells that are still candidates.
+static void FindLocalMaxima(const std::vector<float>& field, int gridResolution, int R, int firstRow, int lastRow, std::vector<unsigned int>& maxima)
+{
+    std::vector<int> halfWidths(2 * R + 1);
+    for (int dy = -R; dy <= R; ++dy)
+    {
+        int halfWidth = 0;
+        while ((halfWidth + 1) * (halfWidth + 1) + dy * dy <= R * (R + 1))
+            ++halfWidth;
+
+        halfWidths[dy + R] = halfWidth;
+    }
+
+    // Rows of the band plus the R rows above and below that its disks reach
+    int haloFirst = std::max(0, firstRow - R);
+    int haloLast = std::min(gridResolution, lastRow + R);
+
+    std::vector<float> rowMax((haloLast - haloFirst) * gridResolution);
+    std::vector<float> padded, prefix, suffix;
+
+    std::set<int> distinctWidths(halfWidths.begin(), halfWidths.end());
+    bool firstWidth = true;
+
+    for (auto width = distinctWidths.rbegin(); width != distinctWidths.rend(); ++width)
+    {
+        for (int y = haloFirst; y < haloLast; ++y)
+        {
+            RowWindowMax(&field[y * gridResolution], gridResolution, *width, &rowMax[(y - haloFirst) * gridResolution], padded, prefix, suffix);
+        }
+
+        if (firstWidth)
+        {
+            // The disk contains the cell itself, so the row maximum only equals the value when nothing in the row is larger
+            maxima.clear();
+            for (int i = firstRow * gridResolution; i < lastRow * gridResolution; ++i)
+            {
+                if (field[i] >= rowMax[i - haloFirst * gridResolution])
+                    maxima.push_back(i);
+            }
+            firstWidth = false;
+        }
+
+        unsigned int kept = 0;
+        for (unsigned int index : maxima)
+        {
+            int x = index % gridResolution;
+            int y = index / gridResolution;
+            bool isLocalMax = true;
+
+            for (int dy = -R; dy <= R && isLocalMax; ++dy)
+            {
+                if (halfWidths[dy + R] != *width || y + dy < 0 || y + dy >= gridResolution)
+                    continue;
+
+                isLocalMax = rowMax[(y + dy - haloFirst) * gridResolution + x] <= field[index];
+            }
+
+            if (isLocalMax)
+                maxima[kept++] = index;
+        }
+        maxima.resize(kept);
+    }
+}
+
+// Direct disk scan, kept as the reference for BenchmarkPlacement
+static void FindLocalMaximaBruteForce(const std::vector<float>& field, int gridResolution, int R, std::vector<unsigned int>& maxima)
+{
+    maxima.clear();
+
+    for (int yc = 0; yc < gridResolution; yc++) {
+        for (int xc = 0; xc < gridResolution; xc++) {
+            float currentValue = field[yc * gridResolution + xc];
+            bool isLocalMax = true;
+
+            for (int dy = -R; dy <= R && isLocalMax; dy++) {
+                for (int dx = -R; dx <= R && isLocalMax; dx++) {
+                    if (dx * dx + dy * dy > R * (R + 1))
+                        continue;
+
+                    int xn = xc + dx;
+                    int yn = yc + dy;
+
+                    if (xn >= 0 && xn < gridResolution && yn >= 0 && yn < gridResolution) {
+                        if (field[yn * gridResolution + xn] > currentValue) {
+                            isLocalMax = false;
+                        }
+                    }
+                }
+            }
+
+            if (isLocalMax)
+                maxima.push_back(yc * gridResolution + xc);
+        }
+    }
+}
+
+void Terrain::SamplePlacementField(float noiseScale, float offsetX, float offsetZ, std::vector<float>& field) const
+{
+    field.resize(resolution * resolution);
+    std::vector<float> rowX(resolution);
+
+    for (unsigned int x = 0; x < resolution; x++) {
+        float worldX = (- size / 2.0f + x * (size / (resolution - 1)) + offsetX);
+        rowX[x] = worldX * noiseScale / size;
+    }
+
+    threadPool->ParallelFor(0, resolution, [&](unsigned int firstRow, unsigned int lastRow)
+    {
+        for (unsigned int y = firstRow; y < lastRow; y++) {
+            float worldZ = (- size / 2.0f + y * (size / (resolution - 1)) + offsetZ);
+            noise.GetNoiseRow(rowX.data(), worldZ * noiseScale / size, resolution, &field[y * resolution]);
+        }
+    });
+}
+
+std::vector<InstanceData> Terrain::GenerateObjectPositions(int R, float noiseScale, float sizeScale, float offsetX, float offsetZ, float modelYOffset) const
+{
+    std::vector<float> field;
+    SamplePlacementField(noiseScale, offsetX, offsetZ, field);
+
+    // Tiles are fixed bands of rows merged in band order, so the instances come out in the same order for any thread count
+    const unsigned int tileRows = 32;
+    unsigned int tileCount = (resolution + tileRows - 1) / tileRows;
+    std::vector<std::vector<InstanceData>> tileInstances(tileCount);
+
+    threadPool->ParallelFor(0, tileCount, [&](unsigned int firstTile, unsigned int lastTile)
+    {
+        std::vector<unsigned int> maxima;
+
+        for (unsigned int tile = firstTile; tile < lastTile; ++tile)
+        {
+            unsigned int firstRow = tile * tileRows;
+            unsigned int lastRow = std::min(resolution, firstRow + tileRows);
+            FindLocalMaxima(field, resolution, R, firstRow, lastRow, maxima);
+
+            for (unsigned int index : maxima) {
+                unsigned int xc = index % resolution;
+                unsigned int yc = index / resolution;
+
+                float localX = -size / 2.0f + xc * (size / (resolution - 1));
+                float localZ = -size / 2.0f + yc * (size / (resolution - 1));
+                float height = SampleHeight(localX + offsetX, localZ + offsetZ);
+                glm::vec3 position = glm::vec3(localX, height + modelYOffset, localZ);
+
+                tileInstances[tile].push_back(InstanceData(position, sizeScale, 0.0f));
+            }
+        }
+    });
+
+    size_t instanceCount = 0;
+    for (auto& tile : tileInstances)
+        instanceCount += tile.size();
+
+    std::vector<InstanceData> instances;
+    instances.reserve(instanceCount);
+    for (auto& tile : tileInstances)
+        instances.insert(instances.end(), tile.begin(), tile.end());
+
+    return instances;
+}
+
+void Terrain::BenchmarkPlacement(float noiseScale, unsigned int iterations) const
+{
+    if (iterations == 0)
+        return;
+
+    std::vector<float> field;
+    SamplePlacementField(noiseScale, offsetX, offsetZ, field);
+
+    const int radii[] = { 1, 2, 3, 4, 6, 8, 12 };
+    for (int R : radii)
+    {
+        std::vector<unsigned int> bruteForceMaxima;
+        std::vector<unsigned int> separableMaxima;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        for (unsigned int i = 0; i < iterations; ++i)
+        {
+            FindLocalMaximaBruteForce(field, resolution, R, bruteForceMaxima);
+        }
+
+        auto bruteForceTime = std::chrono::high_resolution_clock::now();
+
+        for (unsigned int i = 0; i < iterations; ++i)
+        {
+            FindLocalMaxima(field, resolution, R, 0, resolution, separableMaxima);
+        }
+
+        auto separableTime = std::chrono::high_resolution_clock::now();
+
+        std::chrono::duration<double, std::milli> bruteForceDuration = bruteForceTime - startTime;
+        std::chrono::duration<double, std::milli> separableDuration = separableTime - bruteForceTime;
+
+        std::cout << "Placement maxima (" << resolution << "x" << resolution << ", R " << R << "): "
+            << "disk scan " << bruteForceDuration.count() / iterations << " ms, "
+            << "separable " << separableDuration.count() / iterations << " ms, "
+            << separableMaxima.size() << " maxima, "
+            << (separableMaxima == bruteForceMaxima ? "identical" : "MISMATCH") << std::endl;
+    }
+}
@@ -7,25 +7,137 @@
 #include "Shader.h"
 #include "Mesh.h"
 #include "Camera.h"
-#include <fastnoiselite/fast_noise_lite.h>
+#include "FractalNoise.h"
 #include <stb/stb_image.h>
 #include <string>
 #include "Model.h"
+#include "ThreadPool.h"
+#include "HeightMap.h"
+#include "Scatter.h"
+#include "InstanceBvh.h"
+#include <future>
+#include <map>
+#include <set>
+
+typedef std::pair<int, int> ChunkCoord;
+
+// Scattered instances of one scatter tile, stored in a fixed slot of the layer's instance array
+struct ScatterCell {
+    unsigned int slot;
+    unsigned int count;
+    // Hash of the LODs of the chunks under the cell, the cell is rebuilt when they change
+    unsigned long long lodKey;
+};
+
+struct ScatterCellBuild {
+    ChunkCoord coord;
+    unsigned long long lodKey;
+    std::vector<InstanceData> instances;
+};
+
+struct ObjectLayer {
+    int R = 0;
+    float noiseScale = 0.0f;
+    float sizeScale = 1.0f;
+    float modelYOffset = 0.0f;
+    // Scatter layers use species instead of the grid maxima above
+    bool scatter = false;
+    ScatterSpecies species;
+    std::vector<InstanceData> instances;
+    std::vector<InstanceData> backInstances;
+    // Leaves are the scatter slots, or runs of bvhLeafSize instances for grid layers
+    InstanceBvh bvh;
+
+    // Scatter layers keep world-space instances per tile across recenters. Every cell owns slotCapacity entries of instances,
+    // unused entries have a scale of 0 and are skipped by the instance shaders, so only the slots in dirtySlots need uploading.
+    std::map<ChunkCoord, ScatterCell> cells;
+    std::vector<ChunkCoord> wantedCells;
+    std::vector<ScatterCellBuild> builtCells;
+    std::vector<unsigned int> freeSlots;
+    std::set<unsigned int> dirtySlots;
+    unsigned int slotCapacity = 0;
+    bool instancesResized = false;
+};
+
+// Edge order used by TerrainChunk::edgeLods: -Z, +X, +Z, -X
+struct TerrainChunk {
+    int lod = 0;
+    int edgeLods[4] = { 0, 0, 0, 0 };
+    std::vector<Vertex> vertices;
+    Mesh* mesh = nullptr;
+};
+
+// Index buffer for a regular grid, shared by every mesh with that grid resolution
+struct GridIndices {
+    EBO* ebo;
+    GLsizei count;
+    GLenum type;
+};
+
+struct ChunkBuild {
+    ChunkCoord coord;
+    int lod;
+    int edgeLods[4];
+    std::vector<Vertex> vertices;
+};
 
 class Terrain {
 public:
-    Terrain(float size, unsigned int resolution, float heightScale, float noiseFrequency, int octaves, float lacunarity, float gain);
+    // With chunkCount > 0 the terrain is streamed as a grid of world-space chunks (chunkCount per side of the window) instead of one mesh.
+    // With gpuDisplacement the single mesh is a flat grid that terrain.vert displaces from a height texture, so recenters only upload that texture.
+    Terrain(float size, unsigned int resolution, float heightScale, float noiseFrequency, int octaves, float lacunarity, float gain, unsigned int chunkCount = 0, bool gpuDisplacement = false);
     ~Terrain();
+    // Frees the meshes, index buffers and height map, call it before the GL context is destroyed
+    void Delete();
     void Draw(Shader& shader, Camera& camera, glm::mat4 model);
 
     float GetHeightAt(float x, float z) const;
     float GetSize() const { return size; }
+    float GetGridStep() const { return size / (resolution - 1); }
+    float GetChunkSize() const { return chunkCount > 0 ? chunkCells * chunkStep : 0.0f; }
+    size_t GetLoadedChunkCount() const { return chunks.size(); }
+    size_t GetTriangleCount() const;
+
+    // Chunks within lodDistance of the window centre keep full detail, every doubling of the distance halves the resolution (0 = off)
+    void SetLodDistance(float distance) { lodDistance = distance; }
     void UpdateTerrain(float offsetX, float offsetZ);
-    std::vector<glm::mat4> GenerateObjectPositions(int R, float noiseScale, float sizeScale, float offsetX, float offsetZ, float modelYOffset) const;
+    std::vector<InstanceData> GenerateObjectPositions(int R, float noiseScale, float sizeScale, float offsetX, float offsetZ, float modelYOffset) const;
+
+    // Object layers are regenerated together with the terrain, including on the background thread
+    int AddObjectLayer(int R, float noiseScale, float sizeScale, float modelYOffset);
+    // Instances of one species scattered over Poisson-disk points, independent of the terrain resolution
+    int AddScatterLayer(const ScatterSpecies& species);
+    const std::vector<InstanceData>& GetObjectInstances(int layer) const { return objectLayers[layer].instances; }
+    // Scatter layers are in world space, the window centre is subtracted in instance.vert through instanceOrigin
+    glm::vec3 GetObjectOrigin(int layer) const { return objectLayers[layer].scatter ? glm::vec3(offsetX, 0.0f, offsetZ) : glm::vec3(0.0f); }
+    // Uploads the layer's instances to the model, only the changed cells of a scatter layer are written
+    void UploadObjectInstances(int layer, Model& model);
+    // Hierarchy over GetObjectInstances, in world space like the instances, so users subtract GetObjectOrigin for window positions
+    const InstanceBvh& GetObjectBvh(int layer) const { return objectLayers[layer].bvh; }
+    // Window position of the layer's object closest to position within maxDistance, false if there is none
+    bool FindNearestObject(int layer, glm::vec3 position, float maxDistance, glm::vec3& objectPosition) const;
+
+    // Builds the terrain for the given offset on a background thread, the current mesh stays in use until FinishUpdate swaps it in
+    void BeginUpdate(float offsetX, float offsetZ);
+    bool IsUpdatePending() const { return pendingUpdate.valid(); }
+    bool FinishUpdate();
+
+    void SetThreadCount(unsigned int threadCount);
+    unsigned int GetThreadCount() const { return threadPool->GetThreadCount(); }
+    void SetTimingReport(bool enabled) { timingReport = enabled; }
 
+    // Times the triangle accumulation normals against the central difference normals on the current window
+    void BenchmarkNormals(unsigned int iterations);
+
+    // Times the disk scan against the separable local maximum filter for several radii on the current window
+    void BenchmarkPlacement(float noiseScale, unsigned int iterations) const;
 
 private:
     Mesh* terrainMesh;
+    HeightMap* heightMap;
+    ThreadPool* threadPool;
+    Scatter* scatter;
+    bool timingReport = false;
 
     float size;
     unsigned int resolution;
@@ -36,13 +148,72 @@ private:
     float gain;
 
     std::vector<Vertex> vertices;
-    std::vector<GLuint> indices;
+    std::vector<Vertex> backVertices;
+
+    // Padded window heights on the world lattice, reused across recenters
+    std::vector<float> heightRing;
+    int ringOriginX = 0;
+    int ringOriginZ = 0;
+    bool ringValid = false;
+    int sampledHeights = 0;
+
+    // Padded window heights in window order, uploaded to heightMap when the grid is displaced on the GPU
+    std::vector<float> heightMapData;
+    std::vector<float> backHeightMapData;
+
+    std::vector<Texture> textures;
     int textureScale;
 
-    void GenerateTerrain(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+    unsigned int chunkCount;
+    bool gpuDisplacement;
+    unsigned int chunkCells = 0;
+    float chunkStep = 0.0f;
+    float lodDistance = 0.0f;
+    int maxLod = 0;
+    std::map<unsigned int, GridIndices> gridIndices;
+    std::map<ChunkCoord, TerrainChunk> chunks;
+    std::vector<ChunkBuild> builtChunks;
+    std::vector<Mesh*> freeChunkMeshes;
+
+    float offsetX = 0.0f;
+    float offsetZ = 0.0f;
+    float pendingOffsetX = 0.0f;
+    float pendingOffsetZ = 0.0f;
+
+    std::vector<ObjectLayer> objectLayers;
+
+    std::future<void> pendingUpdate;
+    double buildDuration = 0.0;
+    double placementDuration = 0.0;
+
+    void GenerateTerrain(std::vector<Vertex>& vertices);
+    void GenerateIndices(unsigned int gridResolution, std::vector<GLuint>& indices) const;
+    const GridIndices& GetGridIndices(unsigned int gridResolution);
     void CalculateNormals(std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+    std::vector<InstanceData> GenerateLayerInstances(const ObjectLayer& layer, float offsetX, float offsetZ) const;
+    void BuildScatterCells(ObjectLayer& layer, float offsetX, float offsetZ);
+    void ApplyScatterCells(ObjectLayer& layer);
+    void BuildLayerBvh(ObjectLayer& layer);
+    void SamplePlacementField(float noiseScale, float offsetX, float offsetZ, std::vector<float>& field) const;
+
+    void BuildHeights(float offsetX, float offsetZ);
+    void BuildVertices(std::vector<Vertex>& target, float offsetX, float offsetZ);
+    void BuildHeightMap(std::vector<float>& target, float offsetX, float offsetZ);
+    glm::vec2 GetHeightMapOrigin(float offsetX, float offsetZ) const;
+    void UploadVertices();
+
+    std::vector<ChunkCoord> GetVisibleChunks(float offsetX, float offsetZ) const;
+    void BuildChunks(float offsetX, float offsetZ);
+    int GetChunkLod(ChunkCoord coord, float offsetX, float offsetZ) const;
+    unsigned long long GetCellLodKey(ChunkCoord cell, float tileSize, float offsetX, float offsetZ) const;
+    // Height of the chunk mesh for the given window offset, which interpolates between fewer noise samples the coarser the chunk
+    float SampleSurfaceHeight(float worldX, float worldZ, float offsetX, float offsetZ) const;
+    void BuildChunkVertices(ChunkBuild& build) const;
+    void UploadChunks();
+
+    float SampleHeight(float worldX, float worldZ) const { return noise.GetNoise(worldX, worldZ) * heightScale; }
     
-    FastNoiseLite noise;
+    FractalNoise noise;
 };
 
 #endif
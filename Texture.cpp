@@ -1,22 +1,50 @@
 #include "Texture.h"
+#include "TextureCache.h"
+#include "AssetLoader.h"
 
 Texture::Texture(const char* image, const char* textureType, GLuint slot)
 {
 	type = textureType;
+	unit = slot;
+
+	TextureCache::Key key = { TextureCache::CanonicalPath(image), GL_NEAREST_MIPMAP_LINEAR, GL_NEAREST, GL_REPEAT };
+	if (TextureCache::Find(key, id))
+		return;
+
 	int imageWidth, imageHeight, imageChannels;
 	stbi_set_flip_vertically_on_load(false);
-	unsigned char* bytes = stbi_load(image, &imageWidth, &imageHeight, &imageChannels, 0);
+	unsigned char* bytes = AssetLoader::LoadImageFile(image, &imageWidth, &imageHeight, &imageChannels);
 
-	glGenTextures(1, &id);
-	glActiveTexture(GL_TEXTURE0 + slot);
+	Upload(bytes, imageWidth, imageHeight, imageChannels, key);
+}
+
+Texture::Texture(const unsigned char* encoded, size_t size, const char* cacheName, const char* textureType, GLuint slot)
+{
+	type = textureType;
 	unit = slot;
+
+	TextureCache::Key key = { cacheName, GL_NEAREST_MIPMAP_LINEAR, GL_NEAREST, GL_REPEAT };
+	if (TextureCache::Find(key, id))
+		return;
+
+	int imageWidth, imageHeight, imageChannels;
+	stbi_set_flip_vertically_on_load(false);
+	unsigned char* bytes = stbi_load_from_memory(encoded, static_cast<int>(size), &imageWidth, &imageHeight, &imageChannels, 0);
+
+	Upload(bytes, imageWidth, imageHeight, imageChannels, key);
+}
+
+void Texture::Upload(unsigned char* bytes, int imageWidth, int imageHeight, int imageChannels, const TextureCache::Key& key)
+{
+	glGenTextures(1, &id);
+	glActiveTexture(GL_TEXTURE0 + unit);
 	glBindTexture(GL_TEXTURE_2D, id);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, key.minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, key.magFilter);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, key.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, key.wrap);
 
 	if (imageChannels == 4)
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, imageWidth, imageHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
@@ -30,6 +58,9 @@ Texture::Texture(const char* image, const char* textureType, GLuint slot)
 	glGenerateMipmap(GL_TEXTURE_2D);
 	stbi_image_free(bytes);
 	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// RGBA8 storage plus a third for the mipmap chain
+	TextureCache::Insert(key, id, static_cast<GLsizeiptr>(imageWidth) * imageHeight * 4 * 4 / 3);
 }
 
 void Texture::TextureUnit(Shader& shader, const char* uniform, GLuint unit)
@@ -50,7 +81,12 @@ void Texture::Unbind()
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void Texture::AddReference()
+{
+	TextureCache::AddReference(id);
+}
+
 void Texture::Delete()
 {
-	glDeleteTextures(1, &id);
+	TextureCache::Release(id);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <stb/stb_image.h>
 
 #include "Shader.h"
+#include "TextureCache.h"
 
 class Texture
 {
@@ -14,10 +15,18 @@ public:
 	GLuint unit;
 
 	Texture(const char* image, const char* textureType, GLuint slot);
+	// Decodes an image file held in memory, such as one embedded in a .glb, cacheName identifies it in the TextureCache
+	Texture(const unsigned char* encoded, size_t size, const char* cacheName, const char* textureType, GLuint slot);
 
 	void TextureUnit(Shader& shader, const char* uniform, GLuint unit);
 	void Bind();
 	void Unbind();
+	// Copies of a Texture are plain handles, whoever keeps one around adds a reference and drops it with Delete.
+	// TextureCache::EvictUnused deletes textures nobody references.
+	void AddReference();
 	void Delete();
+
+private:
+	void Upload(unsigned char* bytes, int imageWidth, int imageHeight, int imageChannels, const TextureCache::Key& key);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <vector>
+
+std::map<TextureCache::Key, TextureCache::Entry> TextureCache::entries;
+unsigned int TextureCache::hits = 0;
+unsigned int TextureCache::misses = 0;
+GLsizeiptr TextureCache::residentBytes = 0;
+
+bool TextureCache::Key::operator<(const Key& other) const
+{
+	if (path != other.path)
+		return path < other.path;
+	if (minFilter != other.minFilter)
+		return minFilter < other.minFilter;
+	if (magFilter != other.magFilter)
+		return magFilter < other.magFilter;
+	return wrap < other.wrap;
+}
+
+std::string TextureCache::CanonicalPath(const char* path)
+{
+	std::string unified = path;
+	std::replace(unified.begin(), unified.end(), '\\', '/');
+
+	bool absolute = !unified.empty() && unified[0] == '/';
+
+	// Resolves "." and ".." lexically, leading ".." of relative paths are kept
+	std::vector<std::string> parts;
+	size_t begin = 0;
+	while (begin <= unified.size())
+	{
+		size_t end = unified.find('/', begin);
+		if (end == std::string::npos)
+			end = unified.size();
+
+		std::string part = unified.substr(begin, end - begin);
+		if (part == "..")
+		{
+			if (!parts.empty() && parts.back() != "..")
+				parts.pop_back();
+			else if (!absolute)
+				parts.push_back(part);
+		}
+		else if (!part.empty() && part != ".")
+		{
+			parts.push_back(part);
+		}
+
+		begin = end + 1;
+	}
+
+	std::string canonical = absolute ? "/" : "";
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		if (i > 0)
+			canonical += '/';
+		canonical += parts[i];
+	}
+	return canonical;
+}
+
+bool TextureCache::Find(const Key& key, GLuint& id)
+{
+	auto entry = entries.find(key);
+	if (entry == entries.end())
+	{
+		misses++;
+		return false;
+	}
+
+	hits++;
+	id = entry->second.id;
+	return true;
+}
+
+void TextureCache::Insert(const Key& key, GLuint id, GLsizeiptr bytes)
+{
+	entries[key] = { id, bytes, 0 };
+	residentBytes += bytes;
+}
+
+void TextureCache::AddReference(GLuint id)
+{
+	for (auto& entry : entries)
+	{
+		if (entry.second.id == id)
+		{
+			entry.second.references++;
+			return;
+		}
+	}
+}
+
+void TextureCache::Release(GLuint id)
+{
+	for (auto& entry : entries)
+	{
+		if (entry.second.id == id && entry.second.references > 0)
+		{
+			entry.second.references--;
+			return;
+		}
+	}
+}
+
+unsigned int TextureCache::EvictUnused()
+{
+	unsigned int evicted = 0;
+
+	for (auto entry = entries.begin(); entry != entries.end();)
+	{
+		if (entry->second.references == 0)
+		{
+			glDeleteTextures(1, &entry->second.id);
+			residentBytes -= entry->second.bytes;
+			entry = entries.erase(entry);
+			evicted++;
+		}
+		else
+		{
+			++entry;
+		}
+	}
+
+	return evicted;
+}
@@ -0,0 +1,55 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <map>
+#include <string>
+
+// Process-wide registry of the image textures, so every image file is decoded and uploaded once per sampler setup.
+// Owners of a texture handle (meshes, batches, the terrain) hold one reference each, textures without references stay resident until evicted.
+class TextureCache
+{
+public:
+	struct Key
+	{
+		std::string path;
+		GLint minFilter;
+		GLint magFilter;
+		GLint wrap;
+
+		bool operator<(const Key& other) const;
+	};
+
+	// Path with separators unified and relative parts resolved, different spellings of one file give the same key
+	static std::string CanonicalPath(const char* path);
+
+	// Returns true when the texture is resident, the caller's handle holds no reference until an owner adds one
+	static bool Find(const Key& key, GLuint& id);
+	// Registers a texture just uploaded by the caller without references
+	static void Insert(const Key& key, GLuint id, GLsizeiptr bytes);
+	static void AddReference(GLuint id);
+	static void Release(GLuint id);
+
+	// Deletes resident textures without references and returns how many were deleted
+	static unsigned int EvictUnused();
+
+	static unsigned int GetHits() { return hits; }
+	static unsigned int GetMisses() { return misses; }
+	static size_t GetResidentCount() { return entries.size(); }
+	static GLsizeiptr GetResidentBytes() { return residentBytes; }
+
+private:
+	struct Entry
+	{
+		GLuint id;
+		GLsizeiptr bytes;
+		unsigned int references;
+	};
+
+	static std::map<Key, Entry> entries;
+	static unsigned int hits;
+	static unsigned int misses;
+	static GLsizeiptr residentBytes;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	ThreadPool::threadCount = threadCount;
+
+	// The caller of ParallelFor is the last worker
+	for (unsigned int i = 1; i < threadCount; i++)
+	{
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+			if (stopping && jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
+
+void ThreadPool::ParallelFor(unsigned int begin, unsigned int end, const std::function<void(unsigned int, unsigned int)>& task)
+{
+	if (end <= begin)
+		return;
+
+	unsigned int count = end - begin;
+	unsigned int rangeCount = std::min(threadCount, count);
+
+	if (rangeCount == 1)
+	{
+		task(begin, end);
+		return;
+	}
+
+	unsigned int remaining = rangeCount - 1;
+	std::mutex doneMutex;
+	std::condition_variable done;
+
+	auto rangeBegin = [&](unsigned int range) { return begin + static_cast<unsigned int>(static_cast<unsigned long long>(count) * range / rangeCount); };
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (unsigned int range = 1; range < rangeCount; range++)
+		{
+			unsigned int first = rangeBegin(range);
+			unsigned int last = rangeBegin(range + 1);
+			jobs.push([&, first, last]
+			{
+				task(first, last);
+
+				std::lock_guard<std::mutex> doneLock(doneMutex);
+				if (--remaining == 0)
+					done.notify_one();
+			});
+		}
+	}
+	jobAvailable.notify_all();
+
+	task(begin, rangeBegin(1));
+
+	std::unique_lock<std::mutex> lock(doneMutex);
+	done.wait(lock, [&] { return remaining == 0; });
+}
@@ -0,0 +1,38 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int GetThreadCount() const { return threadCount; }
+
+	// Splits [begin, end) into contiguous ranges and runs task(rangeBegin, rangeEnd) on the workers.
+	// The calling thread takes part in the work and returns once every range is done.
+	void ParallelFor(unsigned int begin, unsigned int end, const std::function<void(unsigned int, unsigned int)>& task);
+
+private:
+	unsigned int threadCount;
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	bool stopping = false;
+
+	void WorkerLoop();
+};
+
+#endif
@@ -1,4 +1,11 @@
 #include "VBO.h"
+#include <glm/gtc/packing.hpp>
+
+GLsizeiptr VBO::allocatedBytes = 0;
+
+VBO::VBO()
+{
+}
 
 VBO::VBO(std::vector<Vertex>& vertices)
 {
@@ -6,6 +13,9 @@ VBO::VBO(std::vector<Vertex>& vertices)
 	glBindBuffer(GL_ARRAY_BUFFER, id);
 	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
 	//glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
+
+	capacity = vertices.size() * sizeof(Vertex);
+	allocatedBytes += capacity;
 }
 
 VBO::VBO(std::vector<glm::mat4>& mat4s)
@@ -14,6 +24,73 @@ VBO::VBO(std::vector<glm::mat4>& mat4s)
 	glBindBuffer(GL_ARRAY_BUFFER, id);
 	glBufferData(GL_ARRAY_BUFFER, mat4s.size() * sizeof(glm::mat4), mat4s.data(), GL_STATIC_DRAW);
 	//glBufferData(GL_ARRAY_BUFFER, mat4s.size() * sizeof(glm::mat4), mat4s.data(), GL_DYNAMIC_DRAW);
+
+	capacity = mat4s.size() * sizeof(glm::mat4);
+	allocatedBytes += capacity;
+}
+
+InstanceData::InstanceData(glm::vec3 position, float scale, float yaw)
+	: position(position), scale(glm::packHalf1x16(scale)), yaw(glm::packHalf1x16(yaw))
+{
+}
+
+void VBO::Upload(const void* data, GLsizeiptr size)
+{
+	if (id == 0)
+		glGenBuffers(1, &id);
+
+	glBindBuffer(GL_ARRAY_BUFFER, id);
+
+	if (size > capacity)
+	{
+		glBufferData(GL_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW);
+		allocatedBytes += size - capacity;
+		capacity = size;
+	}
+	else if (size > 0)
+	{
+		glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+	}
+}
+
+void VBO::UploadRange(const void* data, GLintptr offset, GLsizeiptr size)
+{
+	if (id == 0)
+		glGenBuffers(1, &id);
+
+	glBindBuffer(GL_ARRAY_BUFFER, id);
+
+	// The id stays the same so VAOs linked to the buffer keep working, the old contents go through a temporary copy
+	if (offset + size > capacity)
+	{
+		GLsizeiptr newCapacity = offset + size;
+		GLuint copy = 0;
+
+		if (capacity > 0)
+		{
+			glGenBuffers(1, &copy);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, copy);
+			glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_COPY);
+			glCopyBufferSubData(GL_ARRAY_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity);
+		}
+
+		glBufferData(GL_ARRAY_BUFFER, newCapacity, nullptr, GL_DYNAMIC_DRAW);
+
+		if (copy != 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, copy);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, 0, 0, capacity);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glDeleteBuffers(1, &copy);
+		}
+
+		allocatedBytes += newCapacity - capacity;
+		capacity = newCapacity;
+	}
+
+	glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
 }
 
 void VBO::Bind()
@@ -29,4 +106,7 @@ void VBO::Unbind()
 void VBO::Delete()
 {
 	glDeleteBuffers(1, &id);
+	allocatedBytes -= capacity;
+	capacity = 0;
+	id = 0;
 }
\ No newline at end of file
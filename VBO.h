@@ -14,14 +14,35 @@ struct Vertex
 	float height;
 };
 
+// Per instance attributes of instanced meshes, 16 bytes instead of a mat4.
+// scale and yaw (radians about +Y) are half floats, a scale of 0 marks an empty instance that the instance shaders skip.
+struct InstanceData
+{
+	glm::vec3 position;
+	GLushort scale;
+	GLushort yaw;
+
+	InstanceData() : position(0.0f), scale(0), yaw(0) {}
+	InstanceData(glm::vec3 position, float scale, float yaw);
+};
+
 class VBO
 {
 public:
-	GLuint id;
+	GLuint id = 0;
+	GLsizeiptr capacity = 0;
+
+	static GLsizeiptr allocatedBytes;
 
+	VBO();
 	VBO(std::vector<Vertex>& vertices);
 	VBO(std::vector<glm::mat4>& mat4s);
 
+	// Replaces the contents in place, the storage is orphaned when the data fits and only grows when it does not
+	void Upload(const void* data, GLsizeiptr size);
+	// Overwrites part of the existing storage without orphaning it, a range past the end grows the storage and keeps the contents before it
+	void UploadRange(const void* data, GLintptr offset, GLsizeiptr size);
+
 	void Bind();
 	void Unbind();
 	void Delete();
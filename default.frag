@@ -8,6 +8,7 @@ in vec3 color;
 in vec2 textureCoordinate;
 in vec4 fragPositionLight;
 in float height;
+in float impostorFadeIn;
 
 uniform sampler2D diffuse0; 
 uniform sampler2D diffuse1; 
@@ -24,6 +25,14 @@ uniform float fogStart;
 uniform float fogEnd;
 uniform bool enableFog;
 
+// Same 4x4 ordered dither as impostor.frag, a fading mesh keeps exactly the cells its impostor discards
+const float ditherThresholds[16] = float[](
+     0.0f,  8.0f,  2.0f, 10.0f,
+    12.0f,  4.0f, 14.0f,  6.0f,
+     3.0f, 11.0f,  1.0f,  9.0f,
+    15.0f,  7.0f, 13.0f,  5.0f
+);
+
 vec4 blendColor()
 {
     float heightThreshold = 10.0f;
@@ -91,6 +100,10 @@ vec4 directLight(vec4 blendedColor)
 
 void main()
 {
+    ivec2 ditherCell = ivec2(gl_FragCoord.xy) % 4;
+    if (impostorFadeIn > (ditherThresholds[ditherCell.y * 4 + ditherCell.x] + 0.5f) / 16.0f)
+        discard;
+
     vec4 blendedColor = blendColor();
 
     vec4 lightColor = directLight(blendedColor);
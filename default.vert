@@ -12,6 +12,7 @@ out vec3 color;
 out vec2 textureCoordinate;
 out vec4 fragPositionLight;
 out float height;
+out float impostorFadeIn;
 
 uniform mat4 cameraMatrix;
 uniform mat4 model;
@@ -30,6 +31,7 @@ void main()
 	textureCoordinate = aTexture;
 	fragPositionLight = lightProjection * vec4(currentPosition, 1.0f);
 	height = aHeight;
+	impostorFadeIn = 0.0f;
 	
 	gl_Position = cameraMatrix * vec4(currentPosition, 1.0);
 }
\ No newline at end of file
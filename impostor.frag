@@ -0,0 +1,86 @@
+#version 330 core
+
+out vec4 FragColor;
+
+in vec3 currentPosition;
+in vec2 tileCoordinate;
+in float firstView;
+in float secondView;
+in float viewBlend;
+in float fadeIn;
+in vec4 fragPositionLight;
+
+uniform sampler2D impostorAtlas;
+uniform float impostorViewCount;
+
+uniform sampler2D shadowMap;
+
+uniform vec4 lightColor;
+uniform vec3 lightPosition;
+uniform vec3 cameraPosition;
+
+uniform vec3 fogColor;
+uniform float fogStart;
+uniform float fogEnd;
+
+// 4x4 ordered dither thresholds, used to fade the impostor in without sorting or blending
+const float ditherThresholds[16] = float[](
+	 0.0f,  8.0f,  2.0f, 10.0f,
+	12.0f,  4.0f, 14.0f,  6.0f,
+	 3.0f, 11.0f,  1.0f,  9.0f,
+	15.0f,  7.0f, 13.0f,  5.0f
+);
+
+void main()
+{
+	ivec2 ditherCell = ivec2(gl_FragCoord.xy) % 4;
+	if (fadeIn <= (ditherThresholds[ditherCell.y * 4 + ditherCell.x] + 0.5f) / 16.0f)
+		discard;
+
+	vec4 first = texture(impostorAtlas, vec2((firstView + tileCoordinate.x) / impostorViewCount, tileCoordinate.y));
+	vec4 second = texture(impostorAtlas, vec2((secondView + tileCoordinate.x) / impostorViewCount, tileCoordinate.y));
+	vec4 albedo = mix(first, second, viewBlend);
+
+	if (albedo.a < 0.5f)
+		discard;
+	albedo.rgb /= albedo.a;
+
+	// Same light as default.frag gives the tree meshes, whose normals are all (1, 1, 1).
+	// default.frag computes a specular term but does not add it to the color, so it is left out here as well.
+	vec3 currentNormal = normalize(vec3(1.0f));
+	vec3 lightDirection = normalize(lightPosition);
+	float ambient = 0.50f;
+	float diffuse = max(dot(currentNormal, lightDirection), 0.0f);
+
+	// 5x5 PCF like default.frag
+	float shadow = 0.0f;
+	vec3 lightCoordinate = fragPositionLight.xyz / fragPositionLight.w;
+	if (lightCoordinate.z <= 1.0f)
+	{
+		lightCoordinate = (lightCoordinate + 1.0f) / 2.0f;
+		float currentDepth = lightCoordinate.z;
+		float bias = max(0.025f * (1.0f - dot(currentNormal, lightDirection)), 0.0005f);
+
+		int sampleRadius = 2;
+		vec2 pixelSize = 1.0 / textureSize(shadowMap, 0);
+
+		for (int y = -sampleRadius; y <= sampleRadius; y++)
+		{
+			for (int x = -sampleRadius; x <= sampleRadius; x++)
+			{
+				float closestDepth = texture(shadowMap, lightCoordinate.xy + vec2(x, y) * pixelSize).r;
+				if (currentDepth > closestDepth + bias)
+					shadow += 1.0f;
+			}
+		}
+
+		shadow /= pow((sampleRadius * 2 + 1), 2);
+	}
+
+	vec4 litColor = vec4(albedo.rgb, 1.0f) * (diffuse * (1.0f - shadow) + ambient) * lightColor;
+
+	float distance = length(currentPosition - cameraPosition);
+	float fogFactor = clamp((fogEnd - distance) / (fogEnd - fogStart), 0.0, 1.0);
+
+	FragColor = mix(vec4(fogColor, 1.0), litColor, fogFactor);
+}
@@ -0,0 +1,48 @@
+#version 330 core
+
+layout (location = 0) in vec2 aCorner;
+layout (location = 5) in vec3 aInstancePosition;
+layout (location = 6) in vec2 aInstanceScaleYaw;
+
+out vec3 currentPosition;
+out vec2 tileCoordinate;
+out float firstView;
+out float secondView;
+out float viewBlend;
+out float fadeIn;
+out vec4 fragPositionLight;
+
+uniform mat4 cameraMatrix;
+uniform mat4 lightProjection;
+uniform vec3 cameraPosition;
+uniform vec3 instanceOrigin;
+
+uniform float impostorRadius;
+uniform float impostorViewCount;
+uniform float impostorStart;
+uniform float impostorFade;
+
+void main()
+{
+	vec3 center = aInstancePosition - instanceOrigin;
+	vec3 toCamera = cameraPosition - center;
+	vec2 toCameraXZ = length(toCamera.xz) > 0.0f ? normalize(toCamera.xz) : vec2(0.0f, 1.0f);
+
+	// Rotates around Y only, so trees stay upright when seen from above
+	vec3 right = vec3(toCameraXZ.y, 0.0f, -toCameraXZ.x);
+	float size = impostorRadius * aInstanceScaleYaw.x;
+	currentPosition = center + (right * aCorner.x + vec3(0.0f, aCorner.y, 0.0f)) * size;
+
+	// The captured views are spaced evenly around the model, undo the instance yaw to find the two nearest ones
+	float angle = atan(toCameraXZ.x, toCameraXZ.y) - aInstanceScaleYaw.y;
+	float view = mod(angle / 6.28318530718f * impostorViewCount, impostorViewCount);
+	firstView = floor(view);
+	secondView = mod(firstView + 1.0f, impostorViewCount);
+	viewBlend = view - firstView;
+
+	tileCoordinate = aCorner * 0.5f + 0.5f;
+	fadeIn = clamp((length(toCamera) - (impostorStart - impostorFade)) / max(impostorFade, 0.0001f), 0.0f, 1.0f);
+	fragPositionLight = lightProjection * vec4(currentPosition, 1.0f);
+
+	gl_Position = cameraMatrix * vec4(currentPosition, 1.0f);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+out vec4 FragColor;
+
+in vec2 textureCoordinate;
+
+uniform sampler2D diffuse0;
+
+void main()
+{
+	// Unlit colour, impostor.frag lights it the same way default.frag lights the tree meshes
+	FragColor = vec4(texture(diffuse0, textureCoordinate).rgb, 1.0f);
+}
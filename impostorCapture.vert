@@ -0,0 +1,15 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPosition;
+layout (location = 3) in vec2 aTexture;
+
+out vec2 textureCoordinate;
+
+uniform mat4 cameraMatrix;
+
+void main()
+{
+	// Captured in model space like an instance at the origin with scale 1 and no yaw
+	textureCoordinate = aTexture;
+	gl_Position = cameraMatrix * vec4(aPosition, 1.0f);
+}
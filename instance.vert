@@ -5,7 +5,8 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec3 aColor;
 layout (location = 3) in vec2 aTexture;
 layout (location = 4) in float aHeight;
-layout (location = 5) in mat4 aInstanceMatrix;
+layout (location = 5) in vec3 aInstancePosition;
+layout (location = 6) in vec2 aInstanceScaleYaw;
 
 out vec3 currentPosition;
 out vec3 normal;
@@ -13,19 +14,47 @@ out vec3 color;
 out vec2 textureCoordinate;
 out vec4 fragPositionLight;
 out float height;
+out float impostorFadeIn;
 
 uniform mat4 cameraMatrix;
+uniform vec3 cameraPosition;
 
 uniform mat4 lightProjection;
 
+// World position of the scene origin for instances stored in world space
+uniform vec3 instanceOrigin;
+// Instances further than this from instanceOrigin along x or z are not drawn (0 = no limit)
+uniform float instanceExtent;
+// Distances set by Impostor::SetMeshFade, the mesh dithers out over the band where the impostor dithers in (impostorStart = 0 = off)
+uniform float impostorStart;
+uniform float impostorFade;
+
 void main()
 {
-	currentPosition = vec3(aInstanceMatrix * vec4(aPosition, 1.0f));
+	// A scale of 0 marks an empty instance slot, both cases are moved outside the clip volume
+	vec2 instanceOffset = abs(aInstancePosition.xz - instanceOrigin.xz);
+	if (aInstanceScaleYaw.x == 0.0f || (instanceExtent > 0.0f && max(instanceOffset.x, instanceOffset.y) > instanceExtent))
+	{
+		gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+		return;
+	}
+
+	// Same transform as translate * rotate(yaw, +Y) * scale
+	vec3 scaled = aPosition * aInstanceScaleYaw.x;
+	float s = sin(aInstanceScaleYaw.y);
+	float c = cos(aInstanceScaleYaw.y);
+	vec3 rotated = vec3(c * scaled.x + s * scaled.z, scaled.y, c * scaled.z - s * scaled.x);
+
+	currentPosition = rotated + aInstancePosition - instanceOrigin;
 	normal = aNormal;
 	color = aColor;
 	textureCoordinate = aTexture;
 	fragPositionLight = lightProjection * vec4(currentPosition, 1.0f);
 	height = aHeight;
+
+	// Measured from the instance like impostor.vert, so both sides of the fade agree on every pixel of the instance
+	float instanceDistance = length(cameraPosition - (aInstancePosition - instanceOrigin));
+	impostorFadeIn = impostorStart > 0.0f ? clamp((instanceDistance - (impostorStart - impostorFade)) / max(impostorFade, 0.0001f), 0.0f, 1.0f) : 0.0f;
 	
 	gl_Position = cameraMatrix * vec4(currentPosition, 1.0);
 }
\ No newline at end of file
@@ -1,13 +1,30 @@
 #version 330 core
 layout (location = 0) in vec3 aPosition;
-layout (location = 5) in mat4 aInstanceMatrix;
+layout (location = 5) in vec3 aInstancePosition;
+layout (location = 6) in vec2 aInstanceScaleYaw;
 
 uniform mat4 lightProjection;
 uniform mat4 model;
 
+// Same meaning as in instance.vert
+uniform vec3 instanceOrigin;
+uniform float instanceExtent;
+
 
 void main()
 {
+    vec2 instanceOffset = abs(aInstancePosition.xz - instanceOrigin.xz);
+    if (aInstanceScaleYaw.x == 0.0 || (instanceExtent > 0.0 && max(instanceOffset.x, instanceOffset.y) > instanceExtent))
+    {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    vec3 scaled = aPosition * aInstanceScaleYaw.x;
+    float s = sin(aInstanceScaleYaw.y);
+    float c = cos(aInstanceScaleYaw.y);
+    vec3 rotated = vec3(c * scaled.x + s * scaled.z, scaled.y, c * scaled.z - s * scaled.x);
+
     //gl_Position = lightProjection * model * vec4(aPosition, 1.0);
-    gl_Position = lightProjection * aInstanceMatrix * vec4(aPosition, 1.0);
+    gl_Position = lightProjection * vec4(rotated + aInstancePosition - instanceOrigin, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPosition;
+layout (location = 2) in vec3 aColor;
+
+out vec3 currentPosition;
+out vec3 normal;
+out vec3 color;
+out vec2 textureCoordinate;
+out vec4 fragPositionLight;
+out float height;
+out float impostorFadeIn;
+
+uniform mat4 cameraMatrix;
+uniform mat4 model;
+
+uniform mat4 lightProjection;
+
+// Heights of the grid plus a one texel border, texel (x + 1, z + 1) belongs to grid vertex (x, z)
+uniform sampler2D heightMap;
+uniform int gridResolution;
+uniform float gridStep;
+uniform vec2 heightMapOrigin;
+uniform float textureScale;
+
+float heightAt(int x, int z)
+{
+	return texelFetch(heightMap, ivec2(x, z), 0).r;
+}
+
+void main()
+{
+	int x = gl_VertexID % gridResolution + 1;
+	int z = gl_VertexID / gridResolution + 1;
+
+	height = heightAt(x, z);
+	normal = normalize(vec3(heightAt(x - 1, z) - heightAt(x + 1, z), 2.0f * gridStep, heightAt(x, z - 1) - heightAt(x, z + 1)));
+
+	currentPosition = vec3(model * vec4(aPosition.x, height, aPosition.z, 1.0f));
+	color = aColor;
+	textureCoordinate = (heightMapOrigin + vec2(x, z) * gridStep) / textureScale;
+	fragPositionLight = lightProjection * vec4(currentPosition, 1.0f);
+	impostorFadeIn = 0.0f;
+
+	gl_Position = cameraMatrix * vec4(currentPosition, 1.0);
+}